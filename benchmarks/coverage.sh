@@ -0,0 +1,25 @@
+#!/bin/sh
+# Time to exit of a generated program run on its own and under --coverage. The program calls every
+# function ITERATIONS times, only the first call of each one hits breakpoints.
+#
+#   benchmarks/coverage.sh [DEBUGGER] [ITERATIONS] [FUNCTIONS] [UNITS]
+set -e
+
+debugger=$(realpath ${1:-./debugger})
+dir=$(mktemp -d)
+benchmarks/generate.sh ${3:-2000} ${4:-20} $dir/program ${2:-10000}
+
+start=$(date +%s%N)
+$dir/program || true
+end=$(date +%s%N)
+echo "untraced: $(( (end - start) / 1000000 )) ms"
+
+# The lcov file is written to the current directory
+cd $dir
+start=$(date +%s%N)
+$debugger --coverage $dir/program | grep "Time to exit" || echo "no time to exit in the output"
+end=$(date +%s%N)
+echo "coverage: $(( (end - start) / 1000000 )) ms with the startup of the debugger"
+
+cd - > /dev/null
+rm -r $dir
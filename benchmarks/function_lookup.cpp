@@ -0,0 +1,67 @@
+#include <fcntl.h>
+#include <bits/stdc++.h>
+#include "../elf/elf++.hh"
+#include "../dwarf/dwarf++.hh"
+#include "../include/mapped_array.h"
+#include "../include/function_index.h"
+
+using namespace std;
+
+// Builds the function index of a program and looks up random PCs inside its functions, like
+// get_func_using_pc does on every stop. Prints the build time and the lookups per second.
+int main(int argc, char** argv) {
+
+    if(argc < 2) {
+        cerr<<"Usage: function_lookup PROGRAM [LOOKUPS]!!!\n";
+        return -1;
+    }
+    size_t count = argc > 2 ? stoul(argv[2]) : 1000000;
+
+    auto fd = open(argv[1], O_RDONLY);
+    if(fd < 0) {
+        cerr<<"Cannot open "<<argv[1]<<"!!!\n";
+        return -1;
+    }
+    elf::elf ef{elf::create_mmap_loader(fd)};
+    dwarf::dwarf dw{dwarf::elf::create_loader(ef)};
+
+    auto build_start = chrono::steady_clock::now();
+    function_index functions;
+    functions.build(dw);
+    auto build_time = chrono::steady_clock::now() - build_start;
+
+    // The PCs looked up lie in the functions defined at the top level of every unit
+    vector<pair<dwarf::taddr, dwarf::taddr>> ranges;
+    for(auto& compile_unit: dw.compilation_units()) {
+        for(auto& die: compile_unit.root()) {
+            if(die.tag == dwarf::DW_TAG::subprogram && die.has(dwarf::DW_AT::low_pc) && die.has(dwarf::DW_AT::high_pc)) {
+                ranges.push_back({dwarf::at_low_pc(die), dwarf::at_high_pc(die)});
+            }
+        }
+    }
+    if(ranges.empty()) {
+        cerr<<"No function in "<<argv[1]<<"!!!\n";
+        return -1;
+    }
+
+    mt19937_64 random{42};
+    vector<dwarf::taddr> pcs(count);
+    for(auto& pc: pcs) {
+        auto& range = ranges[random() % ranges.size()];
+        pc = range.first + random() % (range.second - range.first);
+    }
+
+    size_t found = 0;
+    auto lookup_start = chrono::steady_clock::now();
+    for(auto pc: pcs) {
+        found += functions.find(pc) != nullptr;
+    }
+    auto lookup_ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - lookup_start).count();
+
+    cout<<functions.size()<<" function ranges indexed in "<<chrono::duration_cast<chrono::milliseconds>(build_time).count()<<" ms"<<endl;
+    cout<<count<<" lookups, "<<found<<" found, average "<<lookup_ns / max<size_t>(count, 1)<<" ns, "
+        <<static_cast<uint64_t>(count * 1e9 / max<int64_t>(lookup_ns, 1))<<" lookups/s"<<endl;
+
+    return found == count ? 0 : 1;
+
+}
@@ -0,0 +1,12 @@
+#!/bin/sh
+# Lookups per second of the function index on a generated program with 10k functions
+#
+#   benchmarks/function_lookup.sh [FUNCTIONS] [UNITS] [LOOKUPS]
+set -e
+
+dir=$(mktemp -d)
+benchmarks/generate.sh ${1:-10000} ${2:-100} $dir/program
+g++ -O2 -std=c++17 benchmarks/function_lookup.cpp -o $dir/function_lookup $(pkg-config --cflags --libs libdwarf++)
+$dir/function_lookup $dir/program ${3:-1000000}
+
+rm -r $dir
@@ -0,0 +1,65 @@
+#!/bin/sh
+# Generates a program with FUNCTIONS functions spread over UNITS compile units and builds it with -g,
+# the input of the benchmarks. main calls every function ITERATIONS times, so none of them is dropped.
+#
+#   benchmarks/generate.sh 10000 100 /tmp/bench/program [ITERATIONS]
+set -e
+
+functions=${1:-10000}
+units=${2:-100}
+output=${3:-bench_program}
+iterations=${4:-1}
+dir=$(mktemp -d)
+per_unit=$(( (functions + units - 1) / units ))
+
+unit=0
+while [ $unit -lt $units ]; do
+    file=$dir/unit$unit.cpp
+    : > $file
+    i=0
+    while [ $i -lt $per_unit ]; do
+        cat >> $file <<END
+int function_${unit}_$i(int value) {
+    int result = value * $i;
+    for(int j = 0; j < 3; j++) {
+        result += j ^ value;
+    }
+    return result;
+}
+END
+        i=$((i + 1))
+    done
+    echo "int unit_$unit(int value) {" >> $file
+    echo "    int result = 0;" >> $file
+    i=0
+    while [ $i -lt $per_unit ]; do
+        echo "    int function_${unit}_$i(int); result += function_${unit}_$i(value);" >> $file
+        i=$((i + 1))
+    done
+    echo "    return result;" >> $file
+    echo "}" >> $file
+    unit=$((unit + 1))
+done
+
+main=$dir/main.cpp
+: > $main
+unit=0
+while [ $unit -lt $units ]; do
+    echo "int unit_$unit(int);" >> $main
+    unit=$((unit + 1))
+done
+echo "int main(int argc, char**) {" >> $main
+echo "    int result = 0;" >> $main
+echo "    for(int i = 0; i < $iterations; i++) {" >> $main
+unit=0
+while [ $unit -lt $units ]; do
+    echo "        result += unit_$unit(argc + i);" >> $main
+    unit=$((unit + 1))
+done
+echo "    }" >> $main
+echo "    return result & 1;" >> $main
+echo "}" >> $main
+
+g++ -g -O0 -Wl,--build-id $dir/*.cpp -o $output
+rm -r $dir
+echo "$output: $((per_unit * units)) functions in $((units + 1)) compile units"
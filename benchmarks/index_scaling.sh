@@ -0,0 +1,21 @@
+#!/bin/sh
+# Time to index a generated program with many compile units, from 1 to N indexing threads.
+# Every run starts with an empty index cache, so that the DWARF info is indexed again.
+#
+#   benchmarks/index_scaling.sh [DEBUGGER] [MAX_THREADS] [FUNCTIONS] [UNITS]
+set -e
+
+debugger=${1:-./debugger}
+max_threads=${2:-$(nproc)}
+dir=$(mktemp -d)
+benchmarks/generate.sh ${3:-20000} ${4:-500} $dir/program
+
+threads=1
+while [ $threads -le $max_threads ]; do
+    export XDG_CACHE_HOME=$dir/cache$threads
+    index=$(echo stats | $debugger --index-threads=$threads $dir/program 2>&1 | grep -o "index: .*stolen" || echo "no index in stats")
+    echo "$threads threads: $index"
+    threads=$((threads + 1))
+done
+
+rm -r $dir
@@ -0,0 +1,20 @@
+#!/bin/sh
+# Cold start (DWARF info indexed and the index saved) against warm start (index mapped from the cache)
+# of the debugger on a generated program, with an empty cache directory.
+#
+#   benchmarks/startup.sh [DEBUGGER] [FUNCTIONS] [UNITS]
+set -e
+
+debugger=${1:-./debugger}
+dir=$(mktemp -d)
+benchmarks/generate.sh ${2:-10000} ${3:-100} $dir/program
+
+export XDG_CACHE_HOME=$dir/cache
+for run in cold warm; do
+    start=$(date +%s%N)
+    index=$(echo stats | $debugger $dir/program 2>&1 | grep -o "index: .*us" || echo "no index in stats")
+    end=$(date +%s%N)
+    echo "$run start: $index, $(( (end - start) / 1000000 )) ms until quit"
+done
+
+rm -r $dir
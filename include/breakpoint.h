@@ -12,18 +12,35 @@ class breakpoint {
         void enable();
         void disable();
 
+        // Same as enable/disable but patch the instruction byte in a copy of the text, so that a batch of
+        // breakpoints can be written back with one write per page
+        void enable(uint8_t& text_byte);
+        void disable(uint8_t& text_byte);
+
         bool is_enabled() {
             return m_enabled;
         }
         intptr_t get_addr() {
             return m_addr;
         }
+        uint8_t get_saved_data() {
+            return m_data;
+        }
+
+        // Counted on every trap, also when a condition or an action lets the program go on
+        void hit() {
+            m_hits++;
+        }
+        uint64_t get_hits() {
+            return m_hits;
+        }
 
     private:
         pid_t m_pid;
         intptr_t m_addr;
         uint8_t m_data;
         bool m_enabled;
+        uint64_t m_hits = 0;
 
 };
 
@@ -59,3 +76,18 @@ void breakpoint::disable() {
     m_enabled = false;
 
 }
+
+void breakpoint::enable(uint8_t& text_byte) {
+
+    m_data = text_byte;
+    text_byte = 0xcc;
+    m_enabled = true;
+
+}
+
+void breakpoint::disable(uint8_t& text_byte) {
+
+    text_byte = m_data;
+    m_enabled = false;
+
+}
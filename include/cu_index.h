@@ -0,0 +1,173 @@
+#include <bits/stdc++.h>
+#include "../dwarf/dwarf++.hh"
+#include "../elf/elf++.hh"
+
+using namespace std;
+
+// PC -> compilation unit lookup table. It is filled from .debug_aranges without reading any DIE,
+// only compile units missing from .debug_aranges fall back to the ranges of their root DIE.
+class cu_index {
+
+    public:
+        struct entry {
+            dwarf::taddr low;
+            dwarf::taddr high;
+            uint64_t cu;
+        };
+
+        cu_index() = default;
+
+        void build(const elf::elf& ef, const dwarf::dwarf& dw);
+        const dwarf::compilation_unit* find(dwarf::taddr pc) const;
+
+        // Position of the compile unit containing pc in dwarf::compilation_units(), -1 if there is none
+        ssize_t find_position(dwarf::taddr pc) const;
+
+    private:
+        friend class index_cache;
+
+        void read_aranges(const elf::elf& ef, const unordered_map<dwarf::section_offset, size_t>& cu_by_offset, vector<bool>& covered);
+
+        const dwarf::dwarf* m_dwarf = nullptr;
+        mapped_array<entry> m_entries;
+
+};
+
+void cu_index::build(const elf::elf& ef, const dwarf::dwarf& dw) {
+
+    m_dwarf = &dw;
+    m_entries.owned().clear();
+
+    auto& compile_units = dw.compilation_units();
+
+    unordered_map<dwarf::section_offset, size_t> cu_by_offset;
+    for(size_t i = 0; i < compile_units.size(); i++) {
+        cu_by_offset[compile_units[i].get_section_offset()] = i;
+    }
+
+    vector<bool> covered(compile_units.size(), false);
+    read_aranges(ef, cu_by_offset, covered);
+
+    // Compile units without an aranges set (or a binary without .debug_aranges at all)
+    for(size_t i = 0; i < compile_units.size(); i++) {
+        if(covered[i]) {
+            continue;
+        }
+
+        auto& root = compile_units[i].root();
+        if(!root.has(dwarf::DW_AT::low_pc) && !root.has(dwarf::DW_AT::ranges)) {
+            continue;
+        }
+
+        for(auto& range: dwarf::die_pc_range(root)) {
+            if(range.low < range.high) {
+                m_entries.owned().push_back(entry{range.low, range.high, i});
+            }
+        }
+    }
+
+    auto& entries = m_entries.owned();
+    sort(entries.begin(), entries.end(), [](const entry& a, const entry& b) { return a.low < b.low; });
+
+}
+
+void cu_index::read_aranges(const elf::elf& ef, const unordered_map<dwarf::section_offset, size_t>& cu_by_offset, vector<bool>& covered) {
+
+    auto& section = ef.get_section(".debug_aranges");
+    if(!section.valid() || section.data() == nullptr) {
+        return;
+    }
+
+    auto start = static_cast<const uint8_t*>(section.data());
+    auto end = start + section.size();
+    auto pos = start;
+
+    auto read = [&](const uint8_t* at, size_t size) {
+        uint64_t value = 0;
+        memcpy(&value, at, size);
+        return value;
+    };
+
+    // Every set is a header followed by (address, length) tuples terminated by (0, 0)
+    while(pos + 4 <= end) {
+        auto set_start = pos;
+
+        uint64_t length = read(pos, 4);
+        unsigned offset_size = 4;
+        pos += 4;
+        if(length == 0xffffffff) {
+            // 64-bit DWARF
+            length = read(pos, 8);
+            offset_size = 8;
+            pos += 8;
+        }
+
+        auto set_end = pos + length;
+        if(set_end > end || pos + 2 + offset_size + 2 > set_end) {
+            break;
+        }
+
+        pos += 2; // version
+        dwarf::section_offset info_offset = read(pos, offset_size);
+        pos += offset_size;
+        unsigned address_size = pos[0];
+        unsigned segment_size = pos[1];
+        pos += 2;
+
+        auto cu = cu_by_offset.find(info_offset);
+        if(cu == cu_by_offset.end() || address_size == 0 || address_size > 8 || segment_size != 0) {
+            pos = set_end;
+            continue;
+        }
+
+        // Tuples are aligned to twice the address size from the start of the set
+        unsigned tuple_size = 2 * address_size;
+        pos = set_start + ((pos - set_start + tuple_size - 1) / tuple_size) * tuple_size;
+
+        while(pos + tuple_size <= set_end) {
+            auto address = read(pos, address_size);
+            auto range_length = read(pos + address_size, address_size);
+            pos += tuple_size;
+
+            if(address == 0 && range_length == 0) {
+                break;
+            }
+            if(range_length != 0) {
+                m_entries.owned().push_back(entry{address, address + range_length, cu->second});
+            }
+        }
+
+        covered[cu->second] = true;
+        pos = set_end;
+    }
+
+}
+
+ssize_t cu_index::find_position(dwarf::taddr pc) const {
+
+    auto iter = upper_bound(m_entries.begin(), m_entries.end(), pc, [](dwarf::taddr addr, const entry& e) { return addr < e.low; });
+
+    if(iter == m_entries.begin()) {
+        return -1;
+    }
+
+    iter--;
+    if(pc >= iter->high) {
+        return -1;
+    }
+
+    return iter->cu;
+
+}
+
+const dwarf::compilation_unit* cu_index::find(dwarf::taddr pc) const {
+
+    auto position = find_position(pc);
+
+    if(position < 0) {
+        return nullptr;
+    }
+
+    return &m_dwarf->compilation_units()[position];
+
+}
@@ -0,0 +1,318 @@
+#include <signal.h>
+#include <pthread.h>
+#include <bits/stdc++.h>
+#include "../dwarf/dwarf++.hh"
+
+using namespace std;
+
+// Builds the function, line and name indexes in worker threads, one compile unit at a time. Every thread starts
+// with a contiguous share of the compile units and steals from the back of the other queues once its own
+// is empty, then merges what it indexed into a per-thread index, so the final merge only combines one index
+// per thread. A lookup that needs a compile unit no thread got to yet indexes it right away in the calling
+// thread, which lets the debugger be interactive while the indexing runs in the background.
+class dwarf_indexer {
+
+    public:
+        // Names are left out when they come from .debug_pubnames
+        dwarf_indexer(const dwarf::dwarf& dw, bool index_names) : m_dwarf{dw}, m_index_names{index_names} {}
+        dwarf_indexer(const dwarf_indexer&) = delete;
+        dwarf_indexer& operator=(const dwarf_indexer&) = delete;
+        ~dwarf_indexer();
+
+        // The calling thread joins the work in wait(), so threads can be 0
+        void start(unsigned threads);
+
+        bool done() const {
+            return m_indexed == m_units.size();
+        }
+
+        // Indexes of the compile unit at position cu, only valid until merge()
+        const function_index& get_functions(size_t cu);
+        const line_index& get_lines(size_t cu);
+
+        // Indexes the remaining compile units in the calling thread too, until all of them are done
+        void wait();
+
+        // Moves the result into the global indexes and frees the per-unit ones, the indexing must be done
+        void merge(function_index& functions, line_index& lines, name_index& names);
+
+        chrono::nanoseconds get_build_time() const {
+            return m_build_time;
+        }
+        uint64_t get_steals() const {
+            return m_steals;
+        }
+
+    private:
+        enum unit_state : int {
+            unit_pending,
+            unit_indexing,
+            unit_indexed
+        };
+
+        struct unit {
+            atomic<int> state{unit_pending};
+            function_index functions;
+            line_index lines;
+            name_index names;
+        };
+
+        // Compile units left to a thread, and the merged indexes of the units it did
+        struct work_queue {
+            mutex lock;
+            deque<size_t> units;
+            vector<size_t> indexed;
+            bool merged = false;
+            function_index functions;
+            line_index lines;
+            name_index names;
+        };
+
+        void prepare_sections();
+        void worker(size_t id);
+        bool take(size_t id, size_t* cu);
+        bool index_unit(size_t cu, size_t id);
+        unit& get_unit(size_t cu);
+
+        const dwarf::dwarf& m_dwarf;
+        bool m_index_names;
+        vector<unique_ptr<unit>> m_units;
+        // One queue per worker thread, the last one belongs to the threads calling wait() and the lookups
+        vector<unique_ptr<work_queue>> m_queues;
+        vector<thread> m_workers;
+
+        atomic<size_t> m_indexed{0};
+        atomic<uint64_t> m_steals{0};
+        atomic<bool> m_stop{false};
+
+        mutex m_mutex;
+        condition_variable m_unit_indexed;
+
+        chrono::steady_clock::time_point m_start;
+        chrono::nanoseconds m_build_time{0};
+
+};
+
+dwarf_indexer::~dwarf_indexer() {
+
+    m_stop = true;
+    for(auto& worker: m_workers) {
+        worker.join();
+    }
+
+}
+
+void dwarf_indexer::start(unsigned threads) {
+
+    m_start = chrono::steady_clock::now();
+
+    auto unit_count = m_dwarf.compilation_units().size();
+    for(size_t i = 0; i < unit_count; i++) {
+        m_units.push_back(make_unique<unit>());
+    }
+
+    // Contiguous shares keep every thread reading neighbouring parts of .debug_info. Without workers
+    // everything is left to the queue of wait().
+    for(unsigned i = 0; i <= threads; i++) {
+        m_queues.push_back(make_unique<work_queue>());
+    }
+    for(size_t cu = 0; cu < unit_count; cu++) {
+        m_queues[cu * threads / unit_count]->units.push_back(cu);
+    }
+
+    prepare_sections();
+
+    // SIGINT and SIGCHLD are read by the debugger from a signalfd, which only works if no thread can take
+    // them. The workers inherit the mask from the time they are created, even before the event loop is set up.
+    sigset_t mask, old_mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+
+    for(unsigned i = 0; i < threads; i++) {
+        m_workers.emplace_back([this, i]() {
+            worker(i);
+        });
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+
+}
+
+// Sections are loaded lazily by libdwarf++ into a shared map, they are all loaded before the workers start
+void dwarf_indexer::prepare_sections() {
+
+    for(auto type: {dwarf::section_type::abbrev, dwarf::section_type::info, dwarf::section_type::line, dwarf::section_type::loc,
+                    dwarf::section_type::ranges, dwarf::section_type::str, dwarf::section_type::types}) {
+        try {
+            m_dwarf.get_section(type);
+        } catch(exception&) {}
+    }
+
+}
+
+void dwarf_indexer::worker(size_t id) {
+
+    size_t cu;
+    while(!m_stop && take(id, &cu)) {
+        index_unit(cu, id);
+    }
+
+    if(m_stop) {
+        return;
+    }
+
+    // The per-unit indexes stay, lookups may still be using them
+    auto& queue = *m_queues[id];
+    vector<const function_index*> function_parts;
+    vector<const line_index*> line_parts;
+    vector<const name_index*> name_parts;
+    for(auto indexed: queue.indexed) {
+        function_parts.push_back(&m_units[indexed]->functions);
+        line_parts.push_back(&m_units[indexed]->lines);
+        name_parts.push_back(&m_units[indexed]->names);
+    }
+
+    queue.functions.merge(m_dwarf, function_parts);
+    queue.lines.merge(line_parts);
+    queue.names.merge(m_dwarf, name_parts);
+    queue.merged = true;
+
+}
+
+// Next compile unit from the front of the thread's own queue, or stolen from the back of another one
+bool dwarf_indexer::take(size_t id, size_t* cu) {
+
+    {
+        auto& own = *m_queues[id];
+        lock_guard<mutex> lock{own.lock};
+        if(!own.units.empty()) {
+            *cu = own.units.front();
+            own.units.pop_front();
+            return true;
+        }
+    }
+
+    for(size_t i = 1; i < m_queues.size(); i++) {
+        auto& victim = *m_queues[(id + i) % m_queues.size()];
+        lock_guard<mutex> lock{victim.lock};
+        if(!victim.units.empty()) {
+            *cu = victim.units.back();
+            victim.units.pop_back();
+            m_steals++;
+            return true;
+        }
+    }
+
+    return false;
+
+}
+
+// Returns false if another thread already claimed the unit
+bool dwarf_indexer::index_unit(size_t cu, size_t id) {
+
+    auto& current = *m_units[cu];
+
+    int expected = unit_pending;
+    if(!current.state.compare_exchange_strong(expected, unit_indexing)) {
+        return false;
+    }
+
+    // A broken compile unit is left without functions and lines
+    try {
+        current.functions.build_unit(m_dwarf, cu);
+        current.lines.build_unit(m_dwarf.compilation_units()[cu]);
+        if(m_index_names) {
+            current.names.build_unit(m_dwarf, cu);
+        }
+    } catch(exception&) {}
+
+    m_queues[id]->indexed.push_back(cu);
+
+    {
+        lock_guard<mutex> lock{m_mutex};
+        current.state = unit_indexed;
+        if(++m_indexed == m_units.size()) {
+            m_build_time = chrono::steady_clock::now() - m_start;
+        }
+    }
+    m_unit_indexed.notify_all();
+
+    return true;
+
+}
+
+dwarf_indexer::unit& dwarf_indexer::get_unit(size_t cu) {
+
+    auto& current = *m_units[cu];
+
+    if(!index_unit(cu, m_queues.size() - 1)) {
+        unique_lock<mutex> lock{m_mutex};
+        m_unit_indexed.wait(lock, [&current]() {
+            return current.state == unit_indexed;
+        });
+    }
+
+    return current;
+
+}
+
+const function_index& dwarf_indexer::get_functions(size_t cu) {
+    return get_unit(cu).functions;
+}
+
+const line_index& dwarf_indexer::get_lines(size_t cu) {
+    return get_unit(cu).lines;
+}
+
+void dwarf_indexer::wait() {
+
+    // Steals like a worker, then waits for the units still being indexed by the others
+    size_t cu;
+    while(take(m_queues.size() - 1, &cu)) {
+        index_unit(cu, m_queues.size() - 1);
+    }
+
+    unique_lock<mutex> lock{m_mutex};
+    m_unit_indexed.wait(lock, [this]() {
+        return done();
+    });
+
+}
+
+void dwarf_indexer::merge(function_index& functions, line_index& lines, name_index& names) {
+
+    for(auto& worker: m_workers) {
+        worker.join();
+    }
+    m_workers.clear();
+
+    // One index per worker, and the units indexed by the lookups and wait() on their own
+    vector<const function_index*> function_parts;
+    vector<const line_index*> line_parts;
+    vector<const name_index*> name_parts;
+    for(auto& queue: m_queues) {
+        if(queue->merged) {
+            function_parts.push_back(&queue->functions);
+            line_parts.push_back(&queue->lines);
+            name_parts.push_back(&queue->names);
+            continue;
+        }
+        for(auto indexed: queue->indexed) {
+            function_parts.push_back(&m_units[indexed]->functions);
+            line_parts.push_back(&m_units[indexed]->lines);
+            name_parts.push_back(&m_units[indexed]->names);
+        }
+    }
+
+    functions.merge(m_dwarf, function_parts);
+    lines.merge(line_parts);
+    if(m_index_names) {
+        names.merge(m_dwarf, name_parts);
+    }
+
+    m_units.clear();
+    m_queues.clear();
+
+}
@@ -0,0 +1,103 @@
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <bits/stdc++.h>
+
+using namespace std;
+
+// epoll loop over file descriptors. Idle tasks run one step at a time whenever no descriptor is ready,
+// and the loop only sleeps once all of them are done.
+class event_loop {
+
+    public:
+        event_loop() : m_epoll_fd{epoll_create1(EPOLL_CLOEXEC)} {}
+        event_loop(const event_loop&) = delete;
+        event_loop& operator=(const event_loop&) = delete;
+        ~event_loop();
+
+        void add(int fd, function<void()> callback);
+        void remove(int fd);
+
+        // The task is called again as long as it returns true
+        void add_idle_task(function<bool()> task);
+
+        // Dispatches the ready descriptors, or runs one idle task step when there are none
+        void run_once();
+        // Runs the idle tasks to completion without waiting for descriptors
+        void run_idle_tasks();
+
+    private:
+        void run_idle_step();
+
+        int m_epoll_fd;
+        unordered_map<int, function<void()>> m_callbacks;
+        deque<function<bool()>> m_idle_tasks;
+
+};
+
+event_loop::~event_loop() {
+    if(m_epoll_fd >= 0) {
+        close(m_epoll_fd);
+    }
+}
+
+void event_loop::add(int fd, function<void()> callback) {
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+
+    if(epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        cerr<<"Cannot watch file descriptor "<<fd<<"!!!\n";
+        return;
+    }
+    m_callbacks[fd] = move(callback);
+
+}
+
+void event_loop::remove(int fd) {
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    m_callbacks.erase(fd);
+}
+
+void event_loop::add_idle_task(function<bool()> task) {
+    m_idle_tasks.push_back(move(task));
+}
+
+void event_loop::run_idle_step() {
+
+    auto task = move(m_idle_tasks.front());
+    m_idle_tasks.pop_front();
+
+    // Round robin between unfinished tasks
+    if(task()) {
+        m_idle_tasks.push_back(move(task));
+    }
+
+}
+
+void event_loop::run_once() {
+
+    epoll_event events[16];
+    auto count = epoll_wait(m_epoll_fd, events, 16, m_idle_tasks.empty() ? -1 : 0);
+
+    if(count == 0 && !m_idle_tasks.empty()) {
+        run_idle_step();
+        return;
+    }
+
+    for(int i = 0; i < count; i++) {
+        auto iter = m_callbacks.find(events[i].data.fd);
+        if(iter != m_callbacks.end()) {
+            // A copy, the callback may remove its own descriptor
+            auto callback = iter->second;
+            callback();
+        }
+    }
+
+}
+
+void event_loop::run_idle_tasks() {
+    while(!m_idle_tasks.empty()) {
+        run_idle_step();
+    }
+}
@@ -0,0 +1,344 @@
+#include <bits/stdc++.h>
+
+using namespace std;
+
+// Condition expression compiled once into bytecode for a stack machine, and run on every hit of a
+// breakpoint. C syntax and precedence over 64-bit signed integers: numbers, registers ($rax), variables
+// resolved when compiling, memory dereference (*addr reads 8 bytes), arithmetic, bitwise, comparison
+// and short-circuit logical operators.
+class expression {
+
+    public:
+        // What an expression reads from the stopped tracee
+        class context {
+            public:
+                virtual ~context() = default;
+                virtual uint64_t get_register(register_type type) = 0;
+                virtual uint64_t read_memory(uint64_t addr) = 0;
+                virtual int64_t get_variable(size_t index) = 0;
+        };
+
+        expression() = default;
+
+        // Identifiers are passed to resolve_variable, which returns the index given back to context::get_variable,
+        // or -1 if there is no such variable. Throws runtime_error on syntax errors.
+        static expression compile(const string& text, const function<ssize_t(const string&)>& resolve_variable);
+
+        int64_t evaluate(context& ctx) const;
+
+        const string& get_text() const {
+            return m_text;
+        }
+        size_t size() const {
+            return m_code.size();
+        }
+
+    private:
+        enum class op : uint8_t {
+            push, reg, var, deref,
+            neg, logical_not, bit_not,
+            add, sub, mul, div, mod, shl, shr,
+            bit_and, bit_or, bit_xor,
+            eq, ne, lt, le, gt, ge,
+            // Short-circuit: jump keeping the left operand as the result, or pop it and run the right one
+            and_jump, or_jump, to_bool
+        };
+
+        struct instruction {
+            op code;
+            int64_t operand;
+        };
+
+        static constexpr size_t max_depth = 64;
+
+        class parser;
+
+        string m_text;
+        vector<instruction> m_code;
+
+};
+
+class expression::parser {
+
+    public:
+        parser(const string& text, const function<ssize_t(const string&)>& resolve_variable, vector<instruction>& code)
+            : m_text{text}, m_resolve_variable{resolve_variable}, m_code{code} {}
+
+        void parse() {
+            parse_binary(0);
+            skip_spaces();
+            if(m_pos != m_text.size()) {
+                throw runtime_error{"Unexpected '" + m_text.substr(m_pos) + "' in condition!!!"};
+            }
+        }
+
+    private:
+        struct binary_op {
+            const char* token;
+            unsigned precedence;
+            op code;
+        };
+
+        void emit(op code, int64_t operand = 0) {
+            m_code.push_back(instruction{code, operand});
+
+            // Operands push one value, binary operators pop two and push one
+            switch(code) {
+                case op::push:
+                case op::reg:
+                case op::var:
+                    m_depth++;
+                    break;
+                case op::deref:
+                case op::neg:
+                case op::logical_not:
+                case op::bit_not:
+                case op::to_bool:
+                    break;
+                default:
+                    m_depth--;
+            }
+
+            if(m_depth > max_depth) {
+                throw runtime_error{"Condition is too deeply nested!!!"};
+            }
+        }
+
+        void skip_spaces() {
+            while(m_pos < m_text.size() && isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+                m_pos++;
+            }
+        }
+
+        bool accept(const char* token) {
+            skip_spaces();
+            auto len = strlen(token);
+            if(m_text.compare(m_pos, len, token) != 0) {
+                return false;
+            }
+            m_pos += len;
+            return true;
+        }
+
+        // Binary operators from the lowest precedence level up, longer tokens first so that "<<" isn't read as "<"
+        void parse_binary(unsigned min_precedence) {
+
+            static const binary_op operators[] = {
+                {"||", 1, op::or_jump}, {"&&", 2, op::and_jump},
+                {"==", 6, op::eq}, {"!=", 6, op::ne}, {"<=", 7, op::le}, {">=", 7, op::ge},
+                {"<<", 8, op::shl}, {">>", 8, op::shr},
+                {"|", 3, op::bit_or}, {"^", 4, op::bit_xor}, {"&", 5, op::bit_and},
+                {"<", 7, op::lt}, {">", 7, op::gt},
+                {"+", 9, op::add}, {"-", 9, op::sub}, {"*", 10, op::mul}, {"/", 10, op::div}, {"%", 10, op::mod}
+            };
+
+            parse_unary();
+
+            while(true) {
+                const binary_op* found = nullptr;
+                for(auto& candidate: operators) {
+                    skip_spaces();
+                    if(m_text.compare(m_pos, strlen(candidate.token), candidate.token) == 0) {
+                        found = &candidate;
+                        break;
+                    }
+                }
+
+                if(found == nullptr || found->precedence < min_precedence) {
+                    return;
+                }
+                m_pos += strlen(found->token);
+
+                if(found->code == op::and_jump || found->code == op::or_jump) {
+                    auto jump = m_code.size();
+                    emit(found->code);
+                    parse_binary(found->precedence + 1);
+                    emit(op::to_bool);
+                    m_code[jump].operand = m_code.size();
+                    continue;
+                }
+
+                parse_binary(found->precedence + 1);
+                emit(found->code);
+            }
+
+        }
+
+        void parse_unary() {
+
+            if(accept("-")) {
+                parse_unary();
+                emit(op::neg);
+            } else if(accept("!")) {
+                parse_unary();
+                emit(op::logical_not);
+            } else if(accept("~")) {
+                parse_unary();
+                emit(op::bit_not);
+            } else if(accept("*")) {
+                parse_unary();
+                emit(op::deref);
+            } else {
+                parse_primary();
+            }
+
+        }
+
+        void parse_primary() {
+
+            skip_spaces();
+            if(m_pos >= m_text.size()) {
+                throw runtime_error{"Unexpected end of condition!!!"};
+            }
+
+            if(accept("(")) {
+                parse_binary(0);
+                if(!accept(")")) {
+                    throw runtime_error{"Missing ')' in condition!!!"};
+                }
+                return;
+            }
+
+            auto c = m_text[m_pos];
+
+            if(isdigit(static_cast<unsigned char>(c))) {
+                size_t len;
+                uint64_t value;
+                try {
+                    value = stoull(m_text.substr(m_pos), &len, 0);
+                } catch(out_of_range&) {
+                    throw runtime_error{"Number too large in condition!!!"};
+                }
+                emit(op::push, static_cast<int64_t>(value));
+                m_pos += len;
+                return;
+            }
+
+            if(c == '$') {
+                m_pos++;
+                auto name = read_identifier();
+                auto iter = find_if(begin(registers), end(registers), [&name](auto&& rg) { return rg.name == name; });
+                if(iter == end(registers)) {
+                    throw runtime_error{"Unknown register $" + name + "!!!"};
+                }
+                emit(op::reg, static_cast<int64_t>(iter->r_type));
+                return;
+            }
+
+            auto name = read_identifier();
+            if(name.empty()) {
+                throw runtime_error{"Unexpected '" + m_text.substr(m_pos) + "' in condition!!!"};
+            }
+
+            auto index = m_resolve_variable(name);
+            if(index < 0) {
+                throw runtime_error{"No variable " + name + " at the breakpoint!!!"};
+            }
+            emit(op::var, index);
+
+        }
+
+        string read_identifier() {
+            auto start = m_pos;
+            while(m_pos < m_text.size() && (isalnum(static_cast<unsigned char>(m_text[m_pos])) || m_text[m_pos] == '_')) {
+                m_pos++;
+            }
+            return m_text.substr(start, m_pos - start);
+        }
+
+        const string& m_text;
+        const function<ssize_t(const string&)>& m_resolve_variable;
+        vector<instruction>& m_code;
+        size_t m_pos = 0;
+        size_t m_depth = 0;
+
+};
+
+expression expression::compile(const string& text, const function<ssize_t(const string&)>& resolve_variable) {
+
+    expression result;
+    result.m_text = text;
+
+    parser{text, resolve_variable, result.m_code}.parse();
+
+    return result;
+
+}
+
+int64_t expression::evaluate(context& ctx) const {
+
+    int64_t stack[max_depth];
+    size_t top = 0;
+
+    for(size_t pc = 0; pc < m_code.size(); pc++) {
+        auto& instr = m_code[pc];
+
+        switch(instr.code) {
+            case op::push:
+                stack[top++] = instr.operand;
+                continue;
+            case op::reg:
+                stack[top++] = ctx.get_register(static_cast<register_type>(instr.operand));
+                continue;
+            case op::var:
+                stack[top++] = ctx.get_variable(instr.operand);
+                continue;
+            case op::deref:
+                stack[top - 1] = ctx.read_memory(stack[top - 1]);
+                continue;
+            case op::neg:
+                stack[top - 1] = -static_cast<uint64_t>(stack[top - 1]);
+                continue;
+            case op::logical_not:
+                stack[top - 1] = !stack[top - 1];
+                continue;
+            case op::bit_not:
+                stack[top - 1] = ~stack[top - 1];
+                continue;
+            case op::to_bool:
+                stack[top - 1] = stack[top - 1] != 0;
+                continue;
+            case op::and_jump:
+            case op::or_jump:
+                // The left operand decides: 0 for &&, anything else for ||
+                if((stack[top - 1] != 0) == (instr.code == op::or_jump)) {
+                    stack[top - 1] = stack[top - 1] != 0;
+                    pc = instr.operand - 1;
+                } else {
+                    top--;
+                }
+                continue;
+            default:
+                break;
+        }
+
+        // Binary operators, wrapping like the unsigned machine arithmetic
+        auto right = stack[--top];
+        auto left = static_cast<uint64_t>(stack[top - 1]);
+        auto& result = stack[top - 1];
+
+        switch(instr.code) {
+            case op::add: result = left + right; break;
+            case op::sub: result = left - right; break;
+            case op::mul: result = left * right; break;
+            // No SIGFPE in the debugger for a division by zero or an overflow
+            case op::div: result = (right == 0 || (right == -1 && result == INT64_MIN)) ? 0 : result / right; break;
+            case op::mod: result = (right == 0 || right == -1) ? 0 : result % right; break;
+            case op::shl: result = left << (right & 63); break;
+            case op::shr: result = result >> (right & 63); break;
+            case op::bit_and: result &= right; break;
+            case op::bit_or: result |= right; break;
+            case op::bit_xor: result ^= right; break;
+            case op::eq: result = result == right; break;
+            case op::ne: result = result != right; break;
+            case op::lt: result = result < right; break;
+            case op::le: result = result <= right; break;
+            case op::gt: result = result > right; break;
+            case op::ge: result = result >= right; break;
+            default: break;
+        }
+    }
+
+    return top ? stack[top - 1] : 0;
+
+}
@@ -0,0 +1,189 @@
+#include <bits/stdc++.h>
+#include "../dwarf/dwarf++.hh"
+
+using namespace std;
+
+// Sorted interval index of subprogram PC ranges, built once from the DWARF info
+// so that PC -> function lookups are a binary search instead of a DIE scan
+class function_index {
+
+    public:
+        // Plain data, so that the entries of the on-disk index are read in place
+        struct entry {
+            dwarf::taddr low;
+            dwarf::taddr high;
+            // Position of the compile unit and offset of the DIE in .debug_info, which locate the DIE
+            uint64_t cu;
+            dwarf::section_offset die_offset;
+        };
+
+        function_index() = default;
+
+        void build(const dwarf::dwarf& dw);
+        // Index of the compile unit at position cu in dwarf::compilation_units()
+        void build_unit(const dwarf::dwarf& dw, size_t cu);
+        // Combines the indexes of several compile units into this one
+        void merge(const dwarf::dwarf& dw, const vector<const function_index*>& parts);
+        const entry* find(dwarf::taddr pc) const;
+        const dwarf::die& get_die(const entry& function) const;
+
+        size_t size() const {
+            return m_entries.size();
+        }
+
+    private:
+        friend class index_cache;
+
+        void add_children(const dwarf::die& parent, size_t cu);
+        void finish();
+
+        const dwarf::dwarf* m_dwarf = nullptr;
+        mapped_array<entry> m_entries;
+        // m_max_high[i] is the largest high pc among m_entries[0..i], it bounds the backward walk for nested ranges
+        mapped_array<dwarf::taddr> m_max_high;
+        // DIEs by .debug_info offset, those of a loaded index are found on first use
+        mutable unordered_map<dwarf::section_offset, dwarf::die> m_dies;
+
+};
+
+// Finds the DIE at a .debug_info offset, only descending into the child whose subtree contains it
+dwarf::die find_die(const dwarf::die& parent, dwarf::section_offset offset) {
+
+    if(parent.get_section_offset() == offset) {
+        return parent;
+    }
+
+    dwarf::die candidate;
+    for(auto& child: parent) {
+        if(child.get_section_offset() > offset) {
+            break;
+        }
+        candidate = child;
+    }
+
+    if(!candidate.valid()) {
+        return candidate;
+    }
+
+    return find_die(candidate, offset);
+
+}
+
+void function_index::build(const dwarf::dwarf& dw) {
+
+    m_dwarf = &dw;
+    m_entries.owned().clear();
+    m_dies.clear();
+
+    auto& compile_units = dw.compilation_units();
+    for(size_t i = 0; i < compile_units.size(); i++) {
+        add_children(compile_units[i].root(), i);
+    }
+
+    finish();
+
+}
+
+void function_index::build_unit(const dwarf::dwarf& dw, size_t cu) {
+
+    m_dwarf = &dw;
+    m_entries.owned().clear();
+    m_dies.clear();
+
+    add_children(dw.compilation_units()[cu].root(), cu);
+
+    finish();
+
+}
+
+void function_index::merge(const dwarf::dwarf& dw, const vector<const function_index*>& parts) {
+
+    m_dwarf = &dw;
+    auto& entries = m_entries.owned();
+    entries.clear();
+    m_dies.clear();
+
+    for(auto part: parts) {
+        entries.insert(entries.end(), part->m_entries.begin(), part->m_entries.end());
+        m_dies.insert(part->m_dies.begin(), part->m_dies.end());
+    }
+
+    finish();
+
+}
+
+void function_index::finish() {
+
+    auto& entries = m_entries.owned();
+    sort(entries.begin(), entries.end(), [](const entry& a, const entry& b) { return a.low < b.low; });
+
+    auto& max_highs = m_max_high.owned();
+    max_highs.resize(entries.size());
+    dwarf::taddr max_high = 0;
+    for(size_t i = 0; i < entries.size(); i++) {
+        max_high = max(max_high, entries[i].high);
+        max_highs[i] = max_high;
+    }
+
+}
+
+void function_index::add_children(const dwarf::die& parent, size_t cu) {
+
+    for(auto& die: parent) {
+        switch(die.tag) {
+            case dwarf::DW_TAG::subprogram:
+            {
+                // Declarations and abstract instances do not have any code
+                if(!die.has(dwarf::DW_AT::low_pc) && !die.has(dwarf::DW_AT::ranges)) {
+                    break;
+                }
+
+                // A function can be split into several ranges (e.g. hot/cold parts)
+                for(auto& range: dwarf::die_pc_range(die)) {
+                    if(range.low < range.high) {
+                        m_entries.owned().push_back(entry{range.low, range.high, cu, die.get_section_offset()});
+                    }
+                }
+                m_dies.emplace(die.get_section_offset(), die);
+                break;
+            }
+            case dwarf::DW_TAG::namespace_:
+            case dwarf::DW_TAG::class_type:
+            case dwarf::DW_TAG::structure_type:
+                // Functions defined inside namespaces and classes are not immediate children of the compile unit
+                add_children(die, cu);
+                break;
+            default:
+                break;
+        }
+    }
+
+}
+
+const function_index::entry* function_index::find(dwarf::taddr pc) const {
+
+    // First entry starting after pc, every candidate lies before it
+    auto iter = upper_bound(m_entries.begin(), m_entries.end(), pc, [](dwarf::taddr addr, const entry& e) { return addr < e.low; });
+    auto i = iter - m_entries.begin();
+
+    while(i > 0 && m_max_high[i - 1] > pc) {
+        i--;
+        if(pc < m_entries[i].high) {
+            return &m_entries[i];
+        }
+    }
+
+    return nullptr;
+
+}
+
+const dwarf::die& function_index::get_die(const entry& function) const {
+
+    auto& die = m_dies[function.die_offset];
+    if(!die.valid()) {
+        die = find_die(m_dwarf->compilation_units()[function.cu].root(), function.die_offset);
+    }
+
+    return die;
+
+}
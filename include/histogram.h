@@ -0,0 +1,106 @@
+#include <bits/stdc++.h>
+
+using namespace std;
+
+// Latency histogram with HDR-style log-linear buckets: values below 128 have their own bucket, larger ones
+// keep their 7 most significant bits, so every recorded value is within 1/64 of its bucket. Any value up to
+// 2^64 fits in less than 4000 buckets, allocated as the largest value grows.
+class latency_histogram {
+
+    public:
+        latency_histogram() = default;
+
+        void record(uint64_t value) {
+            auto index = bucket_index(value);
+            if(index >= m_counts.size()) {
+                m_counts.resize(index + 1);
+            }
+            m_counts[index]++;
+            m_count++;
+            m_sum += value;
+            m_min = min(m_min, value);
+            m_max = max(m_max, value);
+        }
+
+        // Lowest value of the bucket holding the given percentile
+        uint64_t percentile(double percent) const;
+
+        uint64_t get_count() const {
+            return m_count;
+        }
+        uint64_t get_min() const {
+            return m_count ? m_min : 0;
+        }
+        uint64_t get_max() const {
+            return m_max;
+        }
+        uint64_t get_mean() const {
+            return m_count ? m_sum / m_count : 0;
+        }
+
+        // 950ns, 12.5us, 3.20ms, 1.05s
+        static string format_ns(uint64_t ns);
+
+    private:
+        static constexpr unsigned sub_bucket_bits = 6;
+        static constexpr uint64_t sub_bucket_count = 1 << sub_bucket_bits;
+
+        static size_t bucket_index(uint64_t value) {
+            if(value < 2 * sub_bucket_count) {
+                return value;
+            }
+            unsigned shift = 63 - __builtin_clzll(value) - sub_bucket_bits;
+            return shift * sub_bucket_count + (value >> shift);
+        }
+
+        static uint64_t bucket_value(size_t index) {
+            if(index < 2 * sub_bucket_count) {
+                return index;
+            }
+            unsigned shift = index / sub_bucket_count - 1;
+            return (index - shift * sub_bucket_count) << shift;
+        }
+
+        vector<uint64_t> m_counts;
+        uint64_t m_count = 0;
+        uint64_t m_sum = 0;
+        uint64_t m_min = UINT64_MAX;
+        uint64_t m_max = 0;
+
+};
+
+uint64_t latency_histogram::percentile(double percent) const {
+
+    if(m_count == 0) {
+        return 0;
+    }
+
+    auto rank = max<uint64_t>(1, ceil(m_count * percent / 100));
+    uint64_t seen = 0;
+    for(size_t i = 0; i < m_counts.size(); i++) {
+        seen += m_counts[i];
+        if(seen >= rank) {
+            // The bucket can start below the smallest value recorded
+            return min(max(bucket_value(i), get_min()), m_max);
+        }
+    }
+
+    return m_max;
+
+}
+
+string latency_histogram::format_ns(uint64_t ns) {
+
+    char buffer[32];
+    if(ns < 1000) {
+        snprintf(buffer, sizeof(buffer), "%" PRIu64 "ns", ns);
+    } else if(ns < 1000000) {
+        snprintf(buffer, sizeof(buffer), "%.1fus", ns / 1e3);
+    } else if(ns < 1000000000) {
+        snprintf(buffer, sizeof(buffer), "%.2fms", ns / 1e6);
+    } else {
+        snprintf(buffer, sizeof(buffer), "%.2fs", ns / 1e9);
+    }
+    return buffer;
+
+}
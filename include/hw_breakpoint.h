@@ -0,0 +1,181 @@
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#include <unistd.h>
+#include <bits/stdc++.h>
+
+using namespace std;
+
+enum class hw_break_type {
+    execute,
+    write,
+    read_write
+};
+
+string to_string(hw_break_type type) {
+    switch (type) {
+        case hw_break_type::execute:
+            return "execute";
+        case hw_break_type::write:
+            return "write";
+        case hw_break_type::read_write:
+            return "read/write";
+    }
+    return "";
+}
+
+// Hardware breakpoints and watchpoints programmed in the x86 debug registers: DR0-DR3 hold the
+// addresses, DR7 enables the slots and selects their condition and length, DR6 reports which one fired.
+// The registers are per thread and not inherited by new threads, so every thread gets them before it runs.
+class hw_debug_registers {
+
+    public:
+        static constexpr unsigned slot_count = 4;
+
+        struct slot {
+            bool used;
+            uint64_t addr;
+            hw_break_type type;
+            unsigned len;
+        };
+
+        hw_debug_registers() = default;
+
+        // Returns the slot used, or -1 if all slots are taken or the address/length can't be encoded
+        int set(uint64_t addr, hw_break_type type, unsigned len);
+        void clear(unsigned slot);
+
+        // Writes the registers to a stopped thread if they changed since it last got them
+        void sync(pid_t tid);
+        void remove_thread(pid_t tid);
+
+        // Reads and clears DR6 of a thread, returns the slot which triggered its last debug trap or -1
+        int get_triggered_slot(pid_t tid);
+
+        const slot& get_slot(unsigned index) {
+            return m_slots[index];
+        }
+
+    private:
+        void write_debug_register(pid_t tid, unsigned index, uint64_t value);
+        uint64_t read_debug_register(pid_t tid, unsigned index);
+
+        array<slot, slot_count> m_slots{};
+        uint64_t m_dr7 = 0;
+        // Bumped on every change, each thread records the generation it was last synced to
+        uint64_t m_generation = 0;
+        unordered_map<pid_t, uint64_t> m_synced;
+
+};
+
+void hw_debug_registers::write_debug_register(pid_t tid, unsigned index, uint64_t value) {
+    ptrace(PTRACE_POKEUSER, tid, offsetof(struct user, u_debugreg) + index * sizeof(uint64_t), value);
+}
+
+uint64_t hw_debug_registers::read_debug_register(pid_t tid, unsigned index) {
+    return ptrace(PTRACE_PEEKUSER, tid, offsetof(struct user, u_debugreg) + index * sizeof(uint64_t), nullptr);
+}
+
+int hw_debug_registers::set(uint64_t addr, hw_break_type type, unsigned len) {
+
+    // Instruction breakpoints must use a length of 1
+    if(type == hw_break_type::execute) {
+        len = 1;
+    }
+
+    // LEN field of DR7: 00 -> 1 byte, 01 -> 2 bytes, 11 -> 4 bytes, 10 -> 8 bytes. The address must be aligned to it.
+    uint64_t len_bits;
+    switch(len) {
+        case 1: len_bits = 0b00; break;
+        case 2: len_bits = 0b01; break;
+        case 4: len_bits = 0b11; break;
+        case 8: len_bits = 0b10; break;
+        default: return -1;
+    }
+
+    if(addr % len != 0) {
+        return -1;
+    }
+
+    // R/W field of DR7: 00 -> execution, 01 -> data writes, 11 -> data reads or writes
+    uint64_t rw_bits;
+    switch(type) {
+        case hw_break_type::execute: rw_bits = 0b00; break;
+        case hw_break_type::write: rw_bits = 0b01; break;
+        case hw_break_type::read_write: rw_bits = 0b11; break;
+        default: return -1;
+    }
+
+    auto iter = find_if(m_slots.begin(), m_slots.end(), [](auto&& s) { return !s.used; });
+    if(iter == m_slots.end()) {
+        return -1;
+    }
+    unsigned index = iter - m_slots.begin();
+
+    m_dr7 &= ~((0b1111ull << (16 + index * 4)) | (0b11ull << (index * 2)));
+    m_dr7 |= (rw_bits | (len_bits << 2)) << (16 + index * 4);
+    // Local enable bit of the slot
+    m_dr7 |= 1ull << (index * 2);
+
+    *iter = slot{true, addr, type, len};
+    m_generation++;
+    return index;
+
+}
+
+void hw_debug_registers::clear(unsigned index) {
+
+    if(index >= slot_count || !m_slots[index].used) {
+        return;
+    }
+
+    m_dr7 &= ~((0b1111ull << (16 + index * 4)) | (0b11ull << (index * 2)));
+
+    m_slots[index].used = false;
+    m_generation++;
+
+}
+
+void hw_debug_registers::sync(pid_t tid) {
+
+    auto iter = m_synced.find(tid);
+    if(iter != m_synced.end() && iter->second == m_generation) {
+        return;
+    }
+
+    // New threads start with cleared debug registers
+    if(iter == m_synced.end() && m_dr7 == 0) {
+        m_synced[tid] = m_generation;
+        return;
+    }
+
+    // DR7 is cleared first, so that no slot is ever enabled with the address of another one
+    write_debug_register(tid, 7, 0);
+    for(unsigned index = 0; index < slot_count; index++) {
+        write_debug_register(tid, index, m_slots[index].used ? m_slots[index].addr : 0);
+    }
+    write_debug_register(tid, 7, m_dr7);
+
+    m_synced[tid] = m_generation;
+
+}
+
+void hw_debug_registers::remove_thread(pid_t tid) {
+    m_synced.erase(tid);
+}
+
+int hw_debug_registers::get_triggered_slot(pid_t tid) {
+
+    auto dr6 = read_debug_register(tid, 6);
+
+    // The status bits are sticky, so they have to be reset by the debugger
+    write_debug_register(tid, 6, 0);
+
+    for(unsigned index = 0; index < slot_count; index++) {
+        if((dr6 & (1ull << index)) && m_slots[index].used) {
+            return index;
+        }
+    }
+
+    return -1;
+
+}
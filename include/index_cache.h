@@ -0,0 +1,410 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <bits/stdc++.h>
+#include "../elf/elf++.hh"
+#include "../dwarf/dwarf++.hh"
+
+using namespace std;
+
+// On-disk copy of the function, line, symbol, name and compile unit indexes, keyed by the ELF build-id and
+// stored under $XDG_CACHE_HOME/debugger_linux (or ~/.cache/debugger_linux). The file is a header followed by
+// flat arrays located by offsets from the start of the file. The arrays are read in place from the mapping,
+// only the symbol and name entries, which hold string views, are rebuilt from their records.
+class index_cache {
+
+    public:
+        index_cache() = default;
+        index_cache(const index_cache&) = delete;
+        index_cache& operator=(const index_cache&) = delete;
+        ~index_cache();
+
+        // Maps the index of the binary, returns false if there is none or it is stale
+        bool load(const elf::elf& ef, const dwarf::dwarf& dw, function_index& functions, line_index& lines, symbol_table& symbols, name_index& names, cu_index& units);
+        bool save(const elf::elf& ef, const function_index& functions, const line_index& lines, const symbol_table& symbols, const name_index& names, const cu_index& units);
+
+        static string read_build_id(const elf::elf& ef);
+
+    private:
+        static constexpr uint32_t version = 4;
+
+        enum array_id {
+            functions_array,
+            function_max_high_array,
+            line_addresses_array,
+            line_file_ids_array,
+            line_lines_array,
+            line_flags_array,
+            files_array,
+            file_lines_array,
+            file_lines_start_array,
+            symbols_array,
+            symbol_slots_array,
+            symbol_hashes_array,
+            symbol_addresses_array,
+            names_array,
+            unit_ranges_array,
+            strings_array,
+            array_count
+        };
+
+        enum header_flags : uint64_t {
+            // The names were read from .debug_pubnames rather than from the DIEs
+            names_from_pubnames = 1
+        };
+
+        struct header {
+            char magic[8];
+            uint32_t version;
+            uint32_t build_id_size;
+            uint8_t build_id[64];
+            uint64_t flags;
+            // Offset from the start of the file and number of elements of every array
+            uint64_t offsets[array_count];
+            uint64_t counts[array_count];
+        };
+
+        struct string_record {
+            uint64_t offset;
+            uint64_t size;
+        };
+
+        struct symbol_record {
+            uint64_t address;
+            uint64_t size;
+            string_record name;
+            uint64_t type;
+        };
+
+        struct name_record {
+            string_record name;
+            uint64_t cu;
+            uint64_t die_offset;
+            uint64_t kind;
+        };
+
+        static string get_cache_path(const string& build_id);
+
+        template<typename T>
+        const T* get_array(array_id id) const {
+            return reinterpret_cast<const T*>(m_data + m_header->offsets[id]);
+        }
+
+        const uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+        const header* m_header = nullptr;
+
+};
+
+index_cache::~index_cache() {
+    if(m_data != nullptr) {
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+}
+
+string index_cache::read_build_id(const elf::elf& ef) {
+
+    auto& section = ef.get_section(".note.gnu.build-id");
+    if(!section.valid() || section.size() < 12) {
+        return "";
+    }
+
+    // Note header: name size, descriptor size and type, followed by the 4-byte aligned name and descriptor
+    auto data = static_cast<const uint8_t*>(section.data());
+    uint32_t name_size, desc_size;
+    memcpy(&name_size, data, 4);
+    memcpy(&desc_size, data + 4, 4);
+
+    auto desc = data + 12 + ((name_size + 3) & ~3u);
+    if(desc + desc_size > data + section.size() || desc_size > sizeof(header::build_id)) {
+        return "";
+    }
+
+    return string{reinterpret_cast<const char*>(desc), desc_size};
+
+}
+
+string index_cache::get_cache_path(const string& build_id) {
+
+    string dir;
+    if(auto xdg = getenv("XDG_CACHE_HOME")) {
+        dir = xdg;
+    } else if(auto home = getenv("HOME")) {
+        dir = string{home} + "/.cache";
+    } else {
+        return "";
+    }
+    dir += "/debugger_linux";
+
+    stringstream name;
+    for(unsigned char c: build_id) {
+        name<<hex<<setw(2)<<setfill('0')<<static_cast<unsigned>(c);
+    }
+
+    return dir + "/" + name.str() + ".idx";
+
+}
+
+bool index_cache::load(const elf::elf& ef, const dwarf::dwarf& dw, function_index& functions, line_index& lines, symbol_table& symbols, name_index& names, cu_index& units) {
+
+    auto build_id = read_build_id(ef);
+    if(build_id.empty()) {
+        return false;
+    }
+
+    auto fd = open(get_cache_path(build_id).c_str(), O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(header)) {
+        close(fd);
+        return false;
+    }
+
+    auto data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        return false;
+    }
+
+    m_data = static_cast<const uint8_t*>(data);
+    m_size = st.st_size;
+    m_header = reinterpret_cast<const header*>(m_data);
+
+    bool valid = memcmp(m_header->magic, "DBGIDX\0", 8) == 0 && m_header->version == version &&
+                 m_header->build_id_size == build_id.size() && memcmp(m_header->build_id, build_id.data(), build_id.size()) == 0;
+
+    const size_t element_sizes[array_count] = {
+        sizeof(function_index::entry), sizeof(dwarf::taddr), sizeof(dwarf::taddr), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint8_t),
+        sizeof(string_record), sizeof(line_index::line_address), sizeof(uint64_t), sizeof(symbol_record), sizeof(uint32_t), sizeof(uint32_t),
+        sizeof(symbol_table::address_entry), sizeof(name_record), sizeof(cu_index::entry), sizeof(char)
+    };
+    // Arrays are used in place, so they must also be aligned
+    for(unsigned id = 0; valid && id < array_count; id++) {
+        valid = m_header->offsets[id] % 8 == 0 && m_header->offsets[id] <= m_size &&
+                m_header->counts[id] <= (m_size - m_header->offsets[id]) / element_sizes[id];
+    }
+
+    auto count = [this](array_id id) {
+        return m_header->counts[id];
+    };
+
+    // Parallel arrays
+    valid = valid && count(function_max_high_array) == count(functions_array) && count(symbol_hashes_array) == count(symbols_array) &&
+            count(file_lines_start_array) == count(files_array) + 1;
+    for(unsigned id = line_file_ids_array; valid && id <= line_flags_array; id++) {
+        valid = count(static_cast<array_id>(id)) == count(line_addresses_array);
+    }
+
+    for(uint64_t i = 0; valid && i < count(line_file_ids_array); i++) {
+        valid = get_array<uint32_t>(line_file_ids_array)[i] < count(files_array);
+    }
+    for(uint64_t i = 0; valid && i < count(file_lines_start_array); i++) {
+        auto start = get_array<uint64_t>(file_lines_start_array)[i];
+        valid = start <= count(file_lines_array) && (i == 0 ? start == 0 : start >= get_array<uint64_t>(file_lines_start_array)[i - 1]);
+    }
+    valid = valid && get_array<uint64_t>(file_lines_start_array)[count(files_array)] == count(file_lines_array);
+
+    // The hash table is probed until an empty slot, its size is a power of two
+    auto slot_count = valid ? count(symbol_slots_array) : 0;
+    valid = valid && slot_count != 0 && (slot_count & (slot_count - 1)) == 0;
+    bool empty_slot = false;
+    for(uint64_t i = 0; valid && i < slot_count; i++) {
+        auto slot = get_array<uint32_t>(symbol_slots_array)[i];
+        valid = slot <= count(symbols_array);
+        empty_slot = empty_slot || slot == 0;
+    }
+    valid = valid && empty_slot;
+    for(uint64_t i = 0; valid && i < count(symbol_addresses_array); i++) {
+        valid = get_array<symbol_table::address_entry>(symbol_addresses_array)[i].entry < count(symbols_array);
+    }
+
+    // Strings must lie in the string array, and DIEs in their compile unit
+    auto string_count = valid ? count(strings_array) : 0;
+    auto valid_string = [string_count](const string_record& record) {
+        return record.size <= string_count && record.offset <= string_count - record.size;
+    };
+
+    auto& compile_units = dw.compilation_units();
+    vector<dwarf::section_offset> unit_ends;
+    for(size_t i = 1; valid && i < compile_units.size(); i++) {
+        unit_ends.push_back(compile_units[i].get_section_offset());
+    }
+    unit_ends.push_back(ef.get_section(".debug_info").size());
+    auto valid_die = [&compile_units, &unit_ends](uint64_t cu, uint64_t die_offset) {
+        return cu < compile_units.size() && die_offset > compile_units[cu].get_section_offset() && die_offset < unit_ends[cu];
+    };
+
+    for(uint64_t i = 0; valid && i < count(files_array); i++) {
+        valid = valid_string(get_array<string_record>(files_array)[i]);
+    }
+    for(uint64_t i = 0; valid && i < count(symbols_array); i++) {
+        valid = valid_string(get_array<symbol_record>(symbols_array)[i].name);
+    }
+    for(uint64_t i = 0; valid && i < count(names_array); i++) {
+        auto& record = get_array<name_record>(names_array)[i];
+        valid = valid_string(record.name) && valid_die(record.cu, record.die_offset) && record.kind <= static_cast<uint64_t>(name_index::kind::global);
+    }
+    for(uint64_t i = 0; valid && i < count(functions_array); i++) {
+        auto& function = get_array<function_index::entry>(functions_array)[i];
+        valid = valid_die(function.cu, function.die_offset);
+    }
+    for(uint64_t i = 0; valid && i < count(unit_ranges_array); i++) {
+        valid = get_array<cu_index::entry>(unit_ranges_array)[i].cu < compile_units.size();
+    }
+
+    if(!valid) {
+        munmap(data, m_size);
+        m_data = nullptr;
+        m_header = nullptr;
+        return false;
+    }
+
+    auto strings = get_array<char>(strings_array);
+
+    functions.m_dwarf = &dw;
+    functions.m_entries.map(get_array<function_index::entry>(functions_array), count(functions_array));
+    functions.m_max_high.map(get_array<dwarf::taddr>(function_max_high_array), count(function_max_high_array));
+    functions.m_dies.clear();
+
+    auto rows = count(line_addresses_array);
+    lines.m_addresses.map(get_array<dwarf::taddr>(line_addresses_array), rows);
+    lines.m_file_ids.map(get_array<uint32_t>(line_file_ids_array), rows);
+    lines.m_lines.map(get_array<uint32_t>(line_lines_array), rows);
+    lines.m_flags.map(get_array<uint8_t>(line_flags_array), rows);
+    lines.m_file_lines.map(get_array<line_index::line_address>(file_lines_array), count(file_lines_array));
+    lines.m_file_lines_start.map(get_array<uint64_t>(file_lines_start_array), count(file_lines_start_array));
+
+    // Saved without duplicates, so the paths are not interned again
+    auto files = get_array<string_record>(files_array);
+    lines.m_files.clear();
+    lines.m_file_ids_by_path.clear();
+    for(uint64_t i = 0; i < count(files_array); i++) {
+        lines.m_files.push_back(line_index::file{string{strings + files[i].offset, files[i].size}});
+    }
+
+    // Symbol names stay views into the mapping
+    auto symbol_records = get_array<symbol_record>(symbols_array);
+    symbols.m_entries.clear();
+    symbols.m_entries.reserve(count(symbols_array));
+    for(uint64_t i = 0; i < count(symbols_array); i++) {
+        auto& record = symbol_records[i];
+        symbols.m_entries.push_back(symbol_table::entry{string_view{strings + record.name.offset, record.name.size}, record.address,
+                                                        record.size, static_cast<symbol_type>(record.type)});
+    }
+    symbols.index_gnu_hash(ef);
+    symbols.m_slots.map(get_array<uint32_t>(symbol_slots_array), count(symbol_slots_array));
+    symbols.m_hashes.map(get_array<uint32_t>(symbol_hashes_array), count(symbol_hashes_array));
+    symbols.m_by_address.map(get_array<symbol_table::address_entry>(symbol_addresses_array), count(symbol_addresses_array));
+
+    // Saved in name order
+    auto name_records = get_array<name_record>(names_array);
+    names.m_dwarf = &dw;
+    names.m_entries.clear();
+    names.m_entries.reserve(count(names_array));
+    names.m_from_pubnames = m_header->flags & names_from_pubnames;
+    names.m_die_names.reset();
+    for(uint64_t i = 0; i < count(names_array); i++) {
+        auto& record = name_records[i];
+        names.m_entries.push_back(name_index::entry{string_view{strings + record.name.offset, record.name.size}, static_cast<uint32_t>(record.cu),
+                                                    static_cast<name_index::kind>(record.kind), record.die_offset});
+    }
+
+    units.m_dwarf = &dw;
+    units.m_entries.map(get_array<cu_index::entry>(unit_ranges_array), count(unit_ranges_array));
+
+    return true;
+
+}
+
+bool index_cache::save(const elf::elf& ef, const function_index& functions, const line_index& lines, const symbol_table& symbols, const name_index& names, const cu_index& units) {
+
+    auto build_id = read_build_id(ef);
+    auto path = get_cache_path(build_id);
+    if(build_id.empty() || path.empty()) {
+        return false;
+    }
+
+    string strings;
+    auto add_string = [&strings](string_view value) {
+        string_record record{strings.size(), value.size()};
+        strings.append(value.data(), value.size());
+        return record;
+    };
+
+    vector<string_record> files;
+    for(auto& file: lines.m_files) {
+        files.push_back(add_string(file.path));
+    }
+
+    vector<symbol_record> symbol_records;
+    for(auto& sym: symbols.m_entries) {
+        symbol_records.push_back(symbol_record{sym.address, sym.size, add_string(sym.name), static_cast<uint64_t>(sym.type)});
+    }
+
+    vector<name_record> name_records;
+    for(auto& name: names.m_entries) {
+        name_records.push_back(name_record{add_string(name.name), name.cu, name.die_offset, static_cast<uint64_t>(name.name_kind)});
+    }
+
+    header hdr{};
+    memcpy(hdr.magic, "DBGIDX\0", 8);
+    hdr.version = version;
+    hdr.build_id_size = build_id.size();
+    memcpy(hdr.build_id, build_id.data(), build_id.size());
+    hdr.flags = names.from_pubnames() ? names_from_pubnames : 0;
+
+    auto array_of = [](auto& values) {
+        return make_pair(static_cast<const void*>(values.data()), values.size());
+    };
+    const pair<const void*, size_t> arrays[array_count] = {
+        array_of(functions.m_entries), array_of(functions.m_max_high),
+        array_of(lines.m_addresses), array_of(lines.m_file_ids), array_of(lines.m_lines), array_of(lines.m_flags),
+        array_of(files), array_of(lines.m_file_lines), array_of(lines.m_file_lines_start),
+        array_of(symbol_records), array_of(symbols.m_slots), array_of(symbols.m_hashes), array_of(symbols.m_by_address),
+        array_of(name_records), array_of(units.m_entries), array_of(strings)
+    };
+    const size_t element_sizes[array_count] = {
+        sizeof(function_index::entry), sizeof(dwarf::taddr), sizeof(dwarf::taddr), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint8_t),
+        sizeof(string_record), sizeof(line_index::line_address), sizeof(uint64_t), sizeof(symbol_record), sizeof(uint32_t), sizeof(uint32_t),
+        sizeof(symbol_table::address_entry), sizeof(name_record), sizeof(cu_index::entry), sizeof(char)
+    };
+
+    // Every array starts 8-byte aligned
+    uint64_t offset = sizeof(header);
+    for(unsigned id = 0; id < array_count; id++) {
+        offset = (offset + 7) & ~7ull;
+        hdr.offsets[id] = offset;
+        hdr.counts[id] = arrays[id].second;
+        offset += arrays[id].second * element_sizes[id];
+    }
+
+    mkdir(path.substr(0, path.rfind('/', path.rfind('/') - 1)).c_str(), 0755);
+    mkdir(path.substr(0, path.rfind('/')).c_str(), 0755);
+
+    // Written to a temporary file and renamed, so a concurrent debugger never maps a partial index
+    auto tmp_path = path + "." + to_string(getpid());
+    ofstream out(tmp_path, ios::binary);
+    if(!out) {
+        return false;
+    }
+
+    out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    for(unsigned id = 0; id < array_count; id++) {
+        auto padding = hdr.offsets[id] - static_cast<uint64_t>(out.tellp());
+        out.write("\0\0\0\0\0\0\0", padding);
+        out.write(static_cast<const char*>(arrays[id].first), arrays[id].second * element_sizes[id]);
+    }
+    out.close();
+
+    if(!out || rename(tmp_path.c_str(), path.c_str()) < 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    return true;
+
+}
@@ -0,0 +1,356 @@
+#include <bits/stdc++.h>
+#include "../dwarf/dwarf++.hh"
+
+using namespace std;
+
+// Debugger-wide line table of all compile units, stored as parallel arrays sorted by address.
+// PC -> line is a binary search over the addresses and line -> PC a binary search in a per-file map.
+class line_index {
+
+    public:
+        struct file {
+            string path;
+        };
+
+        struct entry {
+            dwarf::taddr address;
+            const line_index::file* file;
+            unsigned line;
+            bool is_stmt;
+            bool end_sequence;
+        };
+
+        class iterator;
+
+        line_index() = default;
+
+        void build(const dwarf::dwarf& dw);
+        // Index of a single compile unit
+        void build_unit(const dwarf::compilation_unit& compile_unit);
+        // Combines the indexes of several compile units into this one
+        void merge(const vector<const line_index*>& parts);
+
+        iterator begin() const;
+        iterator end() const;
+        iterator find_address(dwarf::taddr addr) const;
+        bool find_line(const string& file_name, unsigned line, dwarf::taddr* address_out) const;
+        bool find_line_range(dwarf::taddr addr, dwarf::taddr* low_out, dwarf::taddr* high_out) const;
+
+        size_t size() const {
+            return m_addresses.size();
+        }
+
+    private:
+        friend class iterator;
+        friend class index_cache;
+
+        enum row_flags : uint8_t {
+            row_is_stmt = 1,
+            row_end_sequence = 2
+        };
+
+        struct line_address {
+            uint64_t line;
+            dwarf::taddr address;
+        };
+
+        uint32_t intern_file(const string& path);
+        void add_unit(const dwarf::compilation_unit& compile_unit);
+        void sort_rows();
+        void index_files();
+
+        mapped_array<dwarf::taddr> m_addresses;
+        mapped_array<uint32_t> m_file_ids;
+        mapped_array<uint32_t> m_lines;
+        mapped_array<uint8_t> m_flags;
+
+        // Stored in a deque so that entry::file pointers stay valid while files are added
+        deque<file> m_files;
+        unordered_map<string, uint32_t> m_file_ids_by_path;
+        // The is_stmt rows of every file sorted by line and then address, one file after the other. The rows
+        // of file id start at m_file_lines_start[id], which has one more element for the end of the last file.
+        mapped_array<line_address> m_file_lines;
+        mapped_array<uint64_t> m_file_lines_start;
+
+};
+
+class line_index::iterator {
+
+    public:
+        iterator(const line_index* index, size_t pos) : m_index{index}, m_pos{pos} {}
+
+        const line_index::entry& operator*() {
+            load();
+            return m_entry;
+        }
+
+        const line_index::entry* operator->() {
+            load();
+            return &m_entry;
+        }
+
+        bool operator==(const iterator& o) const {
+            return m_index == o.m_index && m_pos == o.m_pos;
+        }
+
+        bool operator!=(const iterator& o) const {
+            return !(*this == o);
+        }
+
+        iterator& operator++() {
+            m_pos++;
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator tmp(*this);
+            m_pos++;
+            return tmp;
+        }
+
+    private:
+        // Gather the row from the parallel arrays
+        void load() {
+            m_entry.address = m_index->m_addresses[m_pos];
+            m_entry.file = &m_index->m_files[m_index->m_file_ids[m_pos]];
+            m_entry.line = m_index->m_lines[m_pos];
+            m_entry.is_stmt = m_index->m_flags[m_pos] & row_is_stmt;
+            m_entry.end_sequence = m_index->m_flags[m_pos] & row_end_sequence;
+        }
+
+        const line_index* m_index;
+        size_t m_pos;
+        line_index::entry m_entry;
+
+};
+
+void line_index::build(const dwarf::dwarf& dw) {
+
+    for(auto& compile_unit: dw.compilation_units()) {
+        add_unit(compile_unit);
+    }
+
+    sort_rows();
+
+}
+
+void line_index::build_unit(const dwarf::compilation_unit& compile_unit) {
+    add_unit(compile_unit);
+    sort_rows();
+}
+
+void line_index::merge(const vector<const line_index*>& parts) {
+
+    for(auto part: parts) {
+        // File ids are local to every part
+        vector<uint32_t> file_ids;
+        for(auto& part_file: part->m_files) {
+            file_ids.push_back(intern_file(part_file.path));
+        }
+
+        for(size_t i = 0; i < part->m_addresses.size(); i++) {
+            m_addresses.owned().push_back(part->m_addresses[i]);
+            m_file_ids.owned().push_back(file_ids[part->m_file_ids[i]]);
+            m_lines.owned().push_back(part->m_lines[i]);
+            m_flags.owned().push_back(part->m_flags[i]);
+        }
+    }
+
+    sort_rows();
+
+}
+
+// Appends the rows of a compile unit, unsorted
+void line_index::add_unit(const dwarf::compilation_unit& compile_unit) {
+
+    for(auto& line_entry: compile_unit.get_line_table()) {
+        m_addresses.owned().push_back(line_entry.address);
+        m_file_ids.owned().push_back(intern_file(line_entry.file->path));
+        m_lines.owned().push_back(line_entry.line);
+        m_flags.owned().push_back((line_entry.is_stmt ? row_is_stmt : 0) | (line_entry.end_sequence ? row_end_sequence : 0));
+    }
+
+}
+
+void line_index::sort_rows() {
+
+    vector<dwarf::taddr> addresses;
+    vector<uint32_t> file_ids;
+    vector<uint32_t> lines;
+    vector<uint8_t> flags;
+    addresses.swap(m_addresses.owned());
+    file_ids.swap(m_file_ids.owned());
+    lines.swap(m_lines.owned());
+    flags.swap(m_flags.owned());
+
+    // Sort rows by address. A sequence end sharing its address with the start of the next
+    // sequence goes first, so that the last row at or below an address is the one describing it.
+    vector<size_t> order(addresses.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if(addresses[a] != addresses[b]) {
+            return addresses[a] < addresses[b];
+        }
+        return (flags[a] & row_end_sequence) > (flags[b] & row_end_sequence);
+    });
+
+    auto& sorted_addresses = m_addresses.owned();
+    auto& sorted_file_ids = m_file_ids.owned();
+    auto& sorted_lines = m_lines.owned();
+    auto& sorted_flags = m_flags.owned();
+    sorted_addresses.resize(order.size());
+    sorted_file_ids.resize(order.size());
+    sorted_lines.resize(order.size());
+    sorted_flags.resize(order.size());
+
+    for(size_t i = 0; i < order.size(); i++) {
+        sorted_addresses[i] = addresses[order[i]];
+        sorted_file_ids[i] = file_ids[order[i]];
+        sorted_lines[i] = lines[order[i]];
+        sorted_flags[i] = flags[order[i]];
+    }
+
+    index_files();
+
+}
+
+// Builds the per-file line -> address map from the rows sorted by address
+void line_index::index_files() {
+
+    auto is_indexed = [this](size_t i) {
+        return (m_flags[i] & row_is_stmt) && !(m_flags[i] & row_end_sequence);
+    };
+
+    // Counting sort by file, then every file is sorted by line
+    auto& starts = m_file_lines_start.owned();
+    starts.assign(m_files.size() + 1, 0);
+    for(size_t i = 0; i < m_addresses.size(); i++) {
+        if(is_indexed(i)) {
+            starts[m_file_ids[i] + 1]++;
+        }
+    }
+    partial_sum(starts.begin(), starts.end(), starts.begin());
+
+    auto& file_lines = m_file_lines.owned();
+    file_lines.resize(starts.back());
+    auto next = starts;
+    for(size_t i = 0; i < m_addresses.size(); i++) {
+        if(is_indexed(i)) {
+            file_lines[next[m_file_ids[i]]++] = line_address{m_lines[i], m_addresses[i]};
+        }
+    }
+
+    for(size_t id = 0; id < m_files.size(); id++) {
+        sort(file_lines.begin() + starts[id], file_lines.begin() + starts[id + 1], [](const line_address& a, const line_address& b) {
+            return a.line != b.line ? a.line < b.line : a.address < b.address;
+        });
+    }
+
+}
+
+uint32_t line_index::intern_file(const string& path) {
+
+    auto iter = m_file_ids_by_path.find(path);
+    if(iter != m_file_ids_by_path.end()) {
+        return iter->second;
+    }
+
+    uint32_t id = m_files.size();
+    m_files.push_back(file{path});
+    m_file_ids_by_path[path] = id;
+
+    return id;
+
+}
+
+line_index::iterator line_index::begin() const {
+    return iterator{this, 0};
+}
+
+line_index::iterator line_index::end() const {
+    return iterator{this, m_addresses.size()};
+}
+
+line_index::iterator line_index::find_address(dwarf::taddr addr) const {
+
+    // Last row with an address lower than or equal to addr
+    auto iter = upper_bound(m_addresses.begin(), m_addresses.end(), addr);
+    if(iter == m_addresses.begin()) {
+        return end();
+    }
+
+    size_t pos = (iter - m_addresses.begin()) - 1;
+
+    // The address lies in a gap between two sequences
+    if(m_flags[pos] & row_end_sequence) {
+        return end();
+    }
+
+    return iterator{this, pos};
+
+}
+
+// Finds the lowest statement address of line in every file whose path ends with file_name
+bool line_index::find_line(const string& file_name, unsigned line, dwarf::taddr* address_out) const {
+
+    bool found = false;
+
+    for(uint32_t id = 0; id < m_files.size(); id++) {
+        if(!is_suffix(file_name, m_files[id].path)) {
+            continue;
+        }
+
+        // The first row of the line has its lowest address
+        auto file_end = m_file_lines.begin() + m_file_lines_start[id + 1];
+        auto iter = lower_bound(m_file_lines.begin() + m_file_lines_start[id], file_end, line, [](const line_address& e, unsigned value) {
+            return e.line < value;
+        });
+
+        if(iter != file_end && iter->line == line && (!found || iter->address < *address_out)) {
+            *address_out = iter->address;
+            found = true;
+        }
+    }
+
+    return found;
+
+}
+
+// Finds the address range of the consecutive rows sharing the file and line of the row containing addr
+bool line_index::find_line_range(dwarf::taddr addr, dwarf::taddr* low_out, dwarf::taddr* high_out) const {
+
+    auto iter = upper_bound(m_addresses.begin(), m_addresses.end(), addr);
+    if(iter == m_addresses.begin()) {
+        return false;
+    }
+
+    size_t pos = (iter - m_addresses.begin()) - 1;
+    if(m_flags[pos] & row_end_sequence) {
+        return false;
+    }
+
+    auto same_line = [&](size_t other) {
+        return !(m_flags[other] & row_end_sequence) && m_file_ids[other] == m_file_ids[pos] && m_lines[other] == m_lines[pos];
+    };
+
+    size_t first = pos;
+    while(first > 0 && same_line(first - 1)) {
+        first--;
+    }
+
+    size_t last = pos;
+    while(last + 1 < m_addresses.size() && same_line(last + 1)) {
+        last++;
+    }
+
+    // The range ends at the next row, which is either another line or the end of the sequence
+    if(last + 1 >= m_addresses.size()) {
+        return false;
+    }
+
+    *low_out = m_addresses[first];
+    *high_out = m_addresses[last + 1];
+
+    return true;
+
+}
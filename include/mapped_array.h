@@ -0,0 +1,52 @@
+#include <bits/stdc++.h>
+
+using namespace std;
+
+// Array of an index, either owned in a vector or read in place from a mapping like the on-disk index.
+// Reads go through the const members, writes through owned(), which copies a mapped array first.
+template<typename T>
+class mapped_array {
+
+    public:
+        mapped_array() = default;
+
+        // The mapping must outlive the array
+        void map(const T* data, size_t size) {
+            m_owned.clear();
+            m_mapped = data;
+            m_size = size;
+        }
+
+        vector<T>& owned() {
+            if(m_mapped != nullptr) {
+                m_owned.assign(m_mapped, m_mapped + m_size);
+                m_mapped = nullptr;
+            }
+            return m_owned;
+        }
+
+        const T* data() const {
+            return m_mapped != nullptr ? m_mapped : m_owned.data();
+        }
+        size_t size() const {
+            return m_mapped != nullptr ? m_size : m_owned.size();
+        }
+        bool empty() const {
+            return size() == 0;
+        }
+        const T* begin() const {
+            return data();
+        }
+        const T* end() const {
+            return data() + size();
+        }
+        const T& operator[](size_t i) const {
+            return data()[i];
+        }
+
+    private:
+        vector<T> m_owned;
+        const T* m_mapped = nullptr;
+        size_t m_size = 0;
+
+};
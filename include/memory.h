@@ -0,0 +1,222 @@
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <bits/stdc++.h>
+
+using namespace std;
+
+// Page cache of the tracee memory. Pages are read in bulk with process_vm_readv (or /proc/pid/mem when
+// that is not permitted) and kept until the tracee resumes, instead of one PTRACE_PEEKDATA per word.
+class memory_cache {
+
+    public:
+        static constexpr uint64_t page_size = 4096;
+
+        memory_cache(pid_t pid) : m_pid{pid} {}
+        memory_cache(const memory_cache&) = delete;
+        memory_cache& operator=(const memory_cache&) = delete;
+        ~memory_cache();
+
+        // Returns false if any byte of the range is not mapped in the tracee
+        bool read(uint64_t addr, void* buf, size_t len);
+        uint64_t read_word(uint64_t addr);
+        void write(uint64_t addr, const void* buf, size_t len);
+        // Brings the pages of a range into the cache with one read, so that later small reads don't make syscalls
+        void prefetch(uint64_t addr, size_t len);
+
+        // Drops every cached page, must be called when the tracee resumes
+        void invalidate();
+        // Drops the pages overlapping a range which was written without going through the cache
+        void invalidate(uint64_t addr, size_t len);
+
+        uint64_t get_read_syscalls() {
+            return m_read_syscalls;
+        }
+        uint64_t get_page_hits() {
+            return m_page_hits;
+        }
+
+    private:
+        void fetch_pages(const vector<uint64_t>& pages);
+        bool read_from_proc_mem(uint64_t addr, void* buf, size_t len);
+        int get_mem_fd();
+
+        pid_t m_pid;
+        int m_mem_fd = -1;
+        // Pages which could not be read are cached as empty vectors
+        unordered_map<uint64_t, vector<uint8_t>> m_pages;
+
+        uint64_t m_read_syscalls = 0;
+        uint64_t m_page_hits = 0;
+
+};
+
+memory_cache::~memory_cache() {
+    if(m_mem_fd >= 0) {
+        close(m_mem_fd);
+    }
+}
+
+int memory_cache::get_mem_fd() {
+
+    if(m_mem_fd < 0) {
+        m_mem_fd = open(("/proc/" + to_string(m_pid) + "/mem").c_str(), O_RDWR);
+    }
+
+    return m_mem_fd;
+
+}
+
+bool memory_cache::read_from_proc_mem(uint64_t addr, void* buf, size_t len) {
+
+    auto fd = get_mem_fd();
+    if(fd < 0) {
+        return false;
+    }
+
+    m_read_syscalls++;
+    return pread(fd, buf, len, addr) == static_cast<ssize_t>(len);
+
+}
+
+// Reads all missing pages with a single process_vm_readv, the pages it could not read are retried one by one
+void memory_cache::fetch_pages(const vector<uint64_t>& pages) {
+
+    vector<iovec> local(pages.size());
+    vector<iovec> remote(pages.size());
+
+    for(size_t i = 0; i < pages.size(); i++) {
+        auto& page = m_pages[pages[i]];
+        page.resize(page_size);
+        local[i] = {page.data(), page_size};
+        remote[i] = {reinterpret_cast<void*>(pages[i]), page_size};
+    }
+
+    m_read_syscalls++;
+    auto bytes = process_vm_readv(m_pid, local.data(), local.size(), remote.data(), remote.size(), 0);
+
+    // process_vm_readv stops at the first page it can't read
+    size_t done = (bytes > 0) ? (bytes / page_size) : 0;
+
+    for(size_t i = done; i < pages.size(); i++) {
+        auto& page = m_pages[pages[i]];
+        if(!read_from_proc_mem(pages[i], page.data(), page_size)) {
+            page.clear();
+        }
+    }
+
+}
+
+void memory_cache::prefetch(uint64_t addr, size_t len) {
+
+    if(len == 0) {
+        return;
+    }
+
+    vector<uint64_t> missing;
+    for(auto page = addr & ~(page_size - 1); page < addr + len; page += page_size) {
+        if(!m_pages.count(page)) {
+            missing.push_back(page);
+        }
+    }
+
+    if(!missing.empty()) {
+        fetch_pages(missing);
+    }
+
+}
+
+bool memory_cache::read(uint64_t addr, void* buf, size_t len) {
+
+    if(len == 0) {
+        return true;
+    }
+
+    auto first_page = addr & ~(page_size - 1);
+    auto last_page = (addr + len - 1) & ~(page_size - 1);
+
+    vector<uint64_t> missing;
+    for(auto page = first_page; page <= last_page; page += page_size) {
+        if(m_pages.count(page)) {
+            m_page_hits++;
+        } else {
+            missing.push_back(page);
+        }
+    }
+
+    if(!missing.empty()) {
+        fetch_pages(missing);
+    }
+
+    auto out = static_cast<uint8_t*>(buf);
+    for(auto page = first_page; page <= last_page; page += page_size) {
+        auto& data = m_pages[page];
+        if(data.empty()) {
+            return false;
+        }
+
+        auto start = max(addr, page);
+        auto end = min(addr + len, page + page_size);
+        memcpy(out + (start - addr), data.data() + (start - page), end - start);
+    }
+
+    return true;
+
+}
+
+uint64_t memory_cache::read_word(uint64_t addr) {
+
+    uint64_t value = 0;
+    read(addr, &value, sizeof(value));
+    return value;
+
+}
+
+void memory_cache::write(uint64_t addr, const void* buf, size_t len) {
+
+    auto fd = get_mem_fd();
+
+    if(fd < 0 || pwrite(fd, buf, len, addr) != static_cast<ssize_t>(len)) {
+        // Fall back to patching whole words with ptrace
+        auto in = static_cast<const uint8_t*>(buf);
+        for(size_t done = 0; done < len;) {
+            auto word_addr = (addr + done) & ~7ull;
+            auto word = ptrace(PTRACE_PEEKDATA, m_pid, word_addr, nullptr);
+            auto bytes = reinterpret_cast<uint8_t*>(&word);
+
+            for(auto i = (addr + done) - word_addr; i < 8 && done < len; i++, done++) {
+                bytes[i] = in[done];
+            }
+
+            ptrace(PTRACE_POKEDATA, m_pid, word_addr, word);
+        }
+    }
+
+    // Keep the cached pages coherent with what was written
+    auto in = static_cast<const uint8_t*>(buf);
+    for(size_t i = 0; i < len; i++) {
+        auto page = (addr + i) & ~(page_size - 1);
+        auto iter = m_pages.find(page);
+        if(iter != m_pages.end() && !iter->second.empty()) {
+            iter->second[(addr + i) - page] = in[i];
+        }
+    }
+
+}
+
+void memory_cache::invalidate() {
+    m_pages.clear();
+}
+
+void memory_cache::invalidate(uint64_t addr, size_t len) {
+
+    if(len == 0) {
+        return;
+    }
+
+    for(auto page = addr & ~(page_size - 1); page <= addr + len - 1; page += page_size) {
+        m_pages.erase(page);
+    }
+
+}
@@ -0,0 +1,273 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <bits/stdc++.h>
+#include "../elf/elf++.hh"
+#include "../dwarf/dwarf++.hh"
+
+using namespace std;
+
+// Page aligned link address of the segment starting at file offset 0, the load bias of an object is
+// where that segment is mapped minus this address
+uint64_t get_first_load_address(const elf::elf& ef) {
+
+    for(auto& segment: ef.segments()) {
+        if(segment.get_hdr().type == elf::pt::load && segment.get_hdr().offset == 0) {
+            return segment.get_hdr().vaddr & ~(memory_cache::page_size - 1);
+        }
+    }
+
+    return 0;
+
+}
+
+// A shared object mapped in the tracee. Only its ELF file is opened when it gets mapped, the symbols,
+// debug info and unwind tables are indexed the first time something inside it is looked up.
+// Addresses taken and returned by the lookups are runtime addresses.
+class shared_module {
+
+    public:
+        shared_module(const string& path, uint64_t load_address);
+        shared_module(const shared_module&) = delete;
+        shared_module& operator=(const shared_module&) = delete;
+
+        bool valid() const {
+            return m_valid;
+        }
+        const string& get_path() const {
+            return m_path;
+        }
+        uint64_t get_load_address() const {
+            return m_load_address;
+        }
+        uint64_t get_low() const {
+            return m_low;
+        }
+        uint64_t get_high() const {
+            return m_high;
+        }
+
+        bool find_function(uint64_t addr, string* name, uint64_t* start);
+        vector<symbol> lookup_symbol(const string& name);
+        bool find_line(const string& file_name, unsigned line, uint64_t* address_out);
+        // Source file and line of the code at addr
+        bool find_source(uint64_t addr, string* path, unsigned* line);
+        bool unwind(unwind_registers& regs, memory_cache& memory, bool innermost);
+
+    private:
+        void load_indexes();
+
+        string m_path;
+        uint64_t m_load_address;
+        uint64_t m_low = 0;
+        uint64_t m_high = 0;
+        bool m_valid = false;
+        bool m_indexed = false;
+        bool m_has_dwarf = false;
+
+        elf::elf m_elf;
+        dwarf::dwarf m_dwarf;
+        symbol_table m_symbols;
+        function_index m_functions;
+        line_index m_lines;
+        cfi_unwinder m_unwinder;
+
+};
+
+shared_module::shared_module(const string& path, uint64_t load_address) : m_path{path}, m_load_address{load_address} {
+
+    auto file = open(path.c_str(), O_RDONLY);
+    if(file < 0) {
+        return;
+    }
+
+    try {
+        m_elf = elf::elf{elf::create_mmap_loader(file)};
+    } catch(exception&) {
+        return;
+    }
+
+    // The runtime range covers every loadable segment
+    m_low = ~0ull;
+    for(auto& segment: m_elf.segments()) {
+        auto& hdr = segment.get_hdr();
+        if(hdr.type == elf::pt::load) {
+            m_low = min(m_low, load_address + (hdr.vaddr & ~(memory_cache::page_size - 1)));
+            m_high = max(m_high, load_address + hdr.vaddr + hdr.memsz);
+        }
+    }
+
+    m_valid = m_low < m_high;
+
+}
+
+void shared_module::load_indexes() {
+
+    if(m_indexed) {
+        return;
+    }
+    m_indexed = true;
+
+    m_symbols.build(m_elf);
+    m_unwinder.build(m_elf);
+
+    // Most system libraries come without debug info
+    try {
+        m_dwarf = dwarf::dwarf{dwarf::elf::create_loader(m_elf)};
+        m_functions.build(m_dwarf);
+        m_lines.build(m_dwarf);
+        m_has_dwarf = true;
+    } catch(exception&) {
+        m_has_dwarf = false;
+    }
+
+}
+
+bool shared_module::find_function(uint64_t addr, string* name, uint64_t* start) {
+
+    load_indexes();
+    auto offset = addr - m_load_address;
+
+    if(m_has_dwarf) {
+        auto function = m_functions.find(offset);
+        if(function != nullptr) {
+            auto& die = m_functions.get_die(*function);
+            if(die.has(dwarf::DW_AT::name)) {
+                *name = dwarf::at_name(die);
+                *start = function->low + m_load_address;
+                return true;
+            }
+        }
+    }
+
+    auto sym = m_symbols.find_address(offset);
+    if(sym != nullptr) {
+        *name = string{sym->name};
+        *start = sym->address + m_load_address;
+        return true;
+    }
+
+    return false;
+
+}
+
+vector<symbol> shared_module::lookup_symbol(const string& name) {
+
+    load_indexes();
+
+    auto symbols = m_symbols.lookup(name);
+    for(auto& sym: symbols) {
+        // Undefined symbols (imports) have no address
+        if(sym.address != 0) {
+            sym.address += m_load_address;
+        }
+    }
+    return symbols;
+
+}
+
+bool shared_module::find_line(const string& file_name, unsigned line, uint64_t* address_out) {
+
+    load_indexes();
+
+    dwarf::taddr address;
+    if(!m_has_dwarf || !m_lines.find_line(file_name, line, &address)) {
+        return false;
+    }
+
+    *address_out = address + m_load_address;
+    return true;
+
+}
+
+bool shared_module::find_source(uint64_t addr, string* path, unsigned* line) {
+
+    load_indexes();
+
+    if(!m_has_dwarf) {
+        return false;
+    }
+
+    auto entry = m_lines.find_address(addr - m_load_address);
+    if(entry == m_lines.end()) {
+        return false;
+    }
+
+    *path = entry->file->path;
+    *line = entry->line;
+    return true;
+
+}
+
+bool shared_module::unwind(unwind_registers& regs, memory_cache& memory, bool innermost) {
+    load_indexes();
+    return m_unwinder.step(regs, memory, m_load_address, innermost);
+}
+
+// Interval map of the shared objects of the tracee, keyed by the start of their runtime range
+class module_map {
+
+    public:
+        module_map() = default;
+
+        shared_module* find(uint64_t addr);
+
+        // Replaces the objects by the (path, load bias) list of the link map, the ones still mapped at the
+        // same address are kept with their indexes. Returns the number of objects added.
+        size_t update(const vector<pair<string, uint64_t>>& objects);
+
+        template<typename F>
+        void for_each(F callback) {
+            for(auto& entry: m_modules) {
+                callback(*entry.second);
+            }
+        }
+
+        size_t size() const {
+            return m_modules.size();
+        }
+
+    private:
+        map<uint64_t, unique_ptr<shared_module>> m_modules;
+
+};
+
+shared_module* module_map::find(uint64_t addr) {
+
+    auto iter = m_modules.upper_bound(addr);
+    if(iter == m_modules.begin()) {
+        return nullptr;
+    }
+
+    auto& module = (--iter)->second;
+    return addr < module->get_high() ? module.get() : nullptr;
+
+}
+
+size_t module_map::update(const vector<pair<string, uint64_t>>& objects) {
+
+    map<uint64_t, unique_ptr<shared_module>> modules;
+    size_t added = 0;
+
+    for(auto& object: objects) {
+        auto existing = find_if(m_modules.begin(), m_modules.end(), [&object](auto&& entry) {
+            return entry.second && entry.second->get_path() == object.first && entry.second->get_load_address() == object.second;
+        });
+
+        if(existing != m_modules.end()) {
+            auto low = existing->first;
+            modules[low] = move(existing->second);
+            continue;
+        }
+
+        auto module = make_unique<shared_module>(object.first, object.second);
+        if(module->valid()) {
+            auto low = module->get_low();
+            modules[low] = move(module);
+            added++;
+        }
+    }
+
+    m_modules = move(modules);
+    return added;
+
+}
@@ -0,0 +1,306 @@
+#include <bits/stdc++.h>
+#include "../dwarf/dwarf++.hh"
+#include "../elf/elf++.hh"
+
+using namespace std;
+
+// Name -> DIE index of the functions, global variables and types of every compile unit. Names are views
+// into the string sections (.debug_str, .debug_info or .debug_pubnames), so building it allocates no string.
+// Entries are sorted by name, which serves both exact and prefix lookups.
+class name_index {
+
+    public:
+        enum class kind : uint8_t {
+            function,
+            variable,
+            type,
+            // Function or variable read from .debug_pubnames, which doesn't tell them apart
+            global
+        };
+
+        struct entry {
+            string_view name;
+            uint32_t cu;
+            kind name_kind;
+            dwarf::section_offset die_offset;
+        };
+
+        name_index() = default;
+
+        // Reads .debug_pubnames and .debug_pubtypes, returns false when the binary doesn't have them
+        bool read_pubnames(const elf::elf& ef, const dwarf::dwarf& dw);
+        void build(const dwarf::dwarf& dw);
+        // Index of the compile unit at position cu in dwarf::compilation_units()
+        void build_unit(const dwarf::dwarf& dw, size_t cu);
+        // Combines the indexes of several compile units into this one
+        void merge(const dwarf::dwarf& dw, const vector<const name_index*>& parts);
+
+        vector<const entry*> lookup(string_view name) const;
+        vector<const entry*> lookup_prefix(string_view prefix) const;
+        dwarf::die get_die(const entry& name) const;
+
+        // Entries of the name in the DIEs of every compile unit, for the names that .debug_pubnames leaves
+        // out, like static functions and variables or plain method names. The DIEs are only walked once.
+        vector<const entry*> lookup_dies(string_view name) const;
+
+        bool from_pubnames() const {
+            return m_from_pubnames;
+        }
+        size_t size() const {
+            return m_entries.size();
+        }
+
+    private:
+        friend class index_cache;
+
+        void add_children(const dwarf::die& parent, uint32_t cu);
+        void add(const dwarf::die& die, uint32_t cu, kind name_kind);
+        bool read_section(const elf::elf& ef, const string& section_name, kind name_kind, const unordered_map<dwarf::section_offset, size_t>& cu_by_offset);
+        void finish();
+
+        const dwarf::dwarf* m_dwarf = nullptr;
+        vector<entry> m_entries;
+        bool m_from_pubnames = false;
+        // Built from the DIEs on the first lookup_dies()
+        mutable unique_ptr<name_index> m_die_names;
+
+};
+
+bool name_index::read_pubnames(const elf::elf& ef, const dwarf::dwarf& dw) {
+
+    m_dwarf = &dw;
+    m_entries.clear();
+    m_die_names.reset();
+
+    auto& compile_units = dw.compilation_units();
+    unordered_map<dwarf::section_offset, size_t> cu_by_offset;
+    for(size_t i = 0; i < compile_units.size(); i++) {
+        cu_by_offset[compile_units[i].get_section_offset()] = i;
+    }
+
+    if(!read_section(ef, ".debug_pubnames", kind::global, cu_by_offset)) {
+        return false;
+    }
+    read_section(ef, ".debug_pubtypes", kind::type, cu_by_offset);
+
+    m_from_pubnames = true;
+    finish();
+    return true;
+
+}
+
+// Every set is a header followed by (DIE offset in the unit, name) pairs terminated by a 0 offset
+bool name_index::read_section(const elf::elf& ef, const string& section_name, kind name_kind, const unordered_map<dwarf::section_offset, size_t>& cu_by_offset) {
+
+    auto& section = ef.get_section(section_name);
+    if(!section.valid() || section.data() == nullptr) {
+        return false;
+    }
+
+    auto start = static_cast<const char*>(section.data());
+    auto end = start + section.size();
+    auto pos = start;
+
+    auto read = [](const char* at, size_t size) {
+        uint64_t value = 0;
+        memcpy(&value, at, size);
+        return value;
+    };
+
+    while(pos + 4 <= end) {
+        uint64_t length = read(pos, 4);
+        unsigned offset_size = 4;
+        pos += 4;
+        if(length == 0xffffffff) {
+            // 64-bit DWARF
+            length = read(pos, 8);
+            offset_size = 8;
+            pos += 8;
+        }
+
+        auto set_end = pos + length;
+        if(set_end > end || pos + 2 + 2 * offset_size > set_end) {
+            break;
+        }
+
+        pos += 2; // version
+        dwarf::section_offset info_offset = read(pos, offset_size);
+        pos += 2 * offset_size; // offset and size of the unit in .debug_info
+
+        auto cu = cu_by_offset.find(info_offset);
+        while(cu != cu_by_offset.end() && pos + offset_size <= set_end) {
+            auto die_offset = read(pos, offset_size);
+            pos += offset_size;
+            if(die_offset == 0) {
+                break;
+            }
+
+            auto name_end = find(pos, set_end, '\0');
+            if(name_end == set_end) {
+                break;
+            }
+            m_entries.push_back(entry{string_view{pos, static_cast<size_t>(name_end - pos)}, static_cast<uint32_t>(cu->second), name_kind, info_offset + die_offset});
+            pos = name_end + 1;
+        }
+
+        pos = set_end;
+    }
+
+    return true;
+
+}
+
+void name_index::build(const dwarf::dwarf& dw) {
+
+    m_dwarf = &dw;
+    m_entries.clear();
+    m_from_pubnames = false;
+    m_die_names.reset();
+
+    auto& compile_units = dw.compilation_units();
+    for(size_t i = 0; i < compile_units.size(); i++) {
+        add_children(compile_units[i].root(), i);
+    }
+
+    finish();
+
+}
+
+void name_index::build_unit(const dwarf::dwarf& dw, size_t cu) {
+
+    m_dwarf = &dw;
+    m_entries.clear();
+    m_from_pubnames = false;
+    m_die_names.reset();
+
+    add_children(dw.compilation_units()[cu].root(), cu);
+
+    finish();
+
+}
+
+void name_index::merge(const dwarf::dwarf& dw, const vector<const name_index*>& parts) {
+
+    m_dwarf = &dw;
+    m_entries.clear();
+    m_from_pubnames = false;
+    m_die_names.reset();
+
+    for(auto part: parts) {
+        m_entries.insert(m_entries.end(), part->m_entries.begin(), part->m_entries.end());
+    }
+
+    finish();
+
+}
+
+void name_index::add_children(const dwarf::die& parent, uint32_t cu) {
+
+    for(auto& die: parent) {
+        // Declarations are completed by a definition elsewhere
+        if(die.has(dwarf::DW_AT::declaration)) {
+            continue;
+        }
+
+        switch(die.tag) {
+            case dwarf::DW_TAG::subprogram:
+                // Only definitions have code to break in
+                if(die.has(dwarf::DW_AT::low_pc) || die.has(dwarf::DW_AT::ranges)) {
+                    add(die, cu, kind::function);
+                }
+                break;
+            case dwarf::DW_TAG::variable:
+                add(die, cu, kind::variable);
+                break;
+            case dwarf::DW_TAG::namespace_:
+                add_children(die, cu);
+                break;
+            case dwarf::DW_TAG::class_type:
+            case dwarf::DW_TAG::structure_type:
+            case dwarf::DW_TAG::union_type:
+                add(die, cu, kind::type);
+                add_children(die, cu);
+                break;
+            case dwarf::DW_TAG::base_type:
+            case dwarf::DW_TAG::enumeration_type:
+            case dwarf::DW_TAG::typedef_:
+                add(die, cu, kind::type);
+                break;
+            default:
+                break;
+        }
+    }
+
+}
+
+void name_index::add(const dwarf::die& die, uint32_t cu, kind name_kind) {
+
+    // Out of line definitions take their name from the declaration they complete. Only declarations in the
+    // same unit are followed, other units can be read by other indexing threads at the same time.
+    auto named = die;
+    if(!die.has(dwarf::DW_AT::name) && die.has(dwarf::DW_AT::specification)) {
+        auto specification = die[dwarf::DW_AT::specification];
+        if(specification.get_form() == dwarf::DW_FORM::ref_addr || specification.get_form() == dwarf::DW_FORM::ref_sig8) {
+            return;
+        }
+        named = specification.as_reference();
+    }
+
+    if(!named.has(dwarf::DW_AT::name)) {
+        return;
+    }
+
+    size_t size;
+    auto data = named[dwarf::DW_AT::name].as_cstr(&size);
+    m_entries.push_back(entry{string_view{data, size}, cu, name_kind, die.get_section_offset()});
+
+}
+
+void name_index::finish() {
+
+    sort(m_entries.begin(), m_entries.end(), [](const entry& a, const entry& b) {
+        return a.name != b.name ? a.name < b.name : a.die_offset < b.die_offset;
+    });
+
+}
+
+vector<const name_index::entry*> name_index::lookup(string_view name) const {
+
+    vector<const entry*> result;
+
+    auto iter = lower_bound(m_entries.begin(), m_entries.end(), name, [](const entry& e, string_view value) { return e.name < value; });
+    for(; iter != m_entries.end() && iter->name == name; iter++) {
+        result.push_back(&*iter);
+    }
+
+    return result;
+
+}
+
+vector<const name_index::entry*> name_index::lookup_prefix(string_view prefix) const {
+
+    vector<const entry*> result;
+
+    auto iter = lower_bound(m_entries.begin(), m_entries.end(), prefix, [](const entry& e, string_view value) { return e.name < value; });
+    for(; iter != m_entries.end() && iter->name.substr(0, prefix.size()) == prefix; iter++) {
+        result.push_back(&*iter);
+    }
+
+    return result;
+
+}
+
+dwarf::die name_index::get_die(const entry& name) const {
+    return find_die(m_dwarf->compilation_units()[name.cu].root(), name.die_offset);
+}
+
+vector<const name_index::entry*> name_index::lookup_dies(string_view name) const {
+
+    if(!m_die_names) {
+        m_die_names = make_unique<name_index>();
+        m_die_names->build(*m_dwarf);
+    }
+
+    return m_die_names->lookup(name);
+
+}
@@ -0,0 +1,72 @@
+#include <bits/stdc++.h>
+
+using namespace std;
+
+// Stacks collected by the sampling profiler. Samples are kept as raw PCs (innermost first) and only
+// symbolized once, when the collapsed stacks are written.
+class sample_profile {
+
+    public:
+        sample_profile() = default;
+
+        void add(const vector<uint64_t>& stack) {
+            m_stacks[stack]++;
+            m_samples++;
+        }
+
+        // Time the tracee was stopped for one sample
+        void add_overhead(chrono::nanoseconds overhead) {
+            m_overhead += overhead;
+        }
+
+        // Writes one "root;...;leaf count" line per distinct stack, the format read by flamegraph.pl
+        bool write_collapsed(const string& path, const function<string(uint64_t)>& symbolize) const;
+
+        uint64_t get_samples() const {
+            return m_samples;
+        }
+
+        chrono::nanoseconds get_average_overhead() const {
+            return m_samples ? m_overhead / static_cast<int64_t>(m_samples) : chrono::nanoseconds{0};
+        }
+
+    private:
+        map<vector<uint64_t>, uint64_t> m_stacks;
+        uint64_t m_samples = 0;
+        chrono::nanoseconds m_overhead{0};
+
+};
+
+bool sample_profile::write_collapsed(const string& path, const function<string(uint64_t)>& symbolize) const {
+
+    ofstream out(path);
+    if(!out) {
+        return false;
+    }
+
+    // Different PCs of a function collapse into the same frame
+    unordered_map<uint64_t, string> names;
+    map<string, uint64_t> collapsed;
+
+    for(auto& [stack, count]: m_stacks) {
+        string line;
+        for(auto iter = stack.rbegin(); iter != stack.rend(); iter++) {
+            auto name = names.find(*iter);
+            if(name == names.end()) {
+                name = names.emplace(*iter, symbolize(*iter)).first;
+            }
+            if(!line.empty()) {
+                line += ';';
+            }
+            line += name->second;
+        }
+        collapsed[line] += count;
+    }
+
+    for(auto& [line, count]: collapsed) {
+        out<<line<<" "<<count<<"\n";
+    }
+
+    return static_cast<bool>(out);
+
+}
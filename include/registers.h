@@ -50,31 +50,105 @@ array<register_desc, 27> registers {{
     { register_type::gs, 55, "gs" },
 }};
 
-uint64_t get_register_value_from_type(pid_t pid, register_type type) {
-    user_regs_struct regs;
-    ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
+// Snapshot of the tracee registers. They are fetched with one PTRACE_GETREGS per stop and written back
+// with one PTRACE_SETREGS before the tracee resumes, instead of one syscall per register access.
+class register_cache {
+
+    public:
+        register_cache(pid_t pid) : m_pid{pid} {}
+
+        uint64_t get(register_type type);
+        void set(register_type type, uint64_t value);
+
+        // Writes back the dirty registers, must be called before resuming the tracee
+        void flush();
+        // Drops the snapshot, must be called after the tracee resumed
+        void invalidate();
+
+        // Number of register accesses served without a ptrace call
+        uint64_t get_saved_calls() {
+            return m_reads + 2 * m_writes - m_getregs_calls - m_setregs_calls;
+        }
+        uint64_t get_getregs_calls() {
+            return m_getregs_calls;
+        }
+        uint64_t get_setregs_calls() {
+            return m_setregs_calls;
+        }
+
+    private:
+        uint64_t* get_slot(register_type type);
+
+        pid_t m_pid;
+        user_regs_struct m_regs;
+        bool m_valid = false;
+        bool m_dirty = false;
+
+        uint64_t m_reads = 0;
+        uint64_t m_writes = 0;
+        uint64_t m_getregs_calls = 0;
+        uint64_t m_setregs_calls = 0;
+
+};
+
+uint64_t* register_cache::get_slot(register_type type) {
+
+    // A thread that is gone or not stopped has no registers to read, the snapshot stays invalid
+    if(!m_valid) {
+        m_getregs_calls++;
+        if(ptrace(PTRACE_GETREGS, m_pid, nullptr, &m_regs) < 0) {
+            throw runtime_error{"Cannot read the registers of thread " + to_string(m_pid) + "!!!"};
+        }
+        m_valid = true;
+    }
 
     auto iter = find_if(begin(registers), end(registers), [type](auto&& rg) { return rg.r_type==type; });
-    return *(reinterpret_cast<uint64_t*>(&regs) + (iter - begin(registers)));
+    return reinterpret_cast<uint64_t*>(&m_regs) + (iter - begin(registers));
+
 }
 
-void set_register_value(pid_t pid,  register_type type, uint64_t value) {
-    user_regs_struct regs;
-    ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
+uint64_t register_cache::get(register_type type) {
+    m_reads++;
+    return *get_slot(type);
+}
 
-    auto iter = find_if(begin(registers), end(registers), [type](auto&& rg) { return rg.r_type==type; });
-    *(reinterpret_cast<uint64_t*>(&regs) + (iter - begin(registers))) = value;
-    ptrace(PTRACE_SETREGS, pid, nullptr, &regs);
+void register_cache::set(register_type type, uint64_t value) {
+    m_writes++;
+    *get_slot(type) = value;
+    m_dirty = true;
+}
+
+void register_cache::flush() {
+
+    if(m_dirty) {
+        ptrace(PTRACE_SETREGS, m_pid, nullptr, &m_regs);
+        m_setregs_calls++;
+        m_dirty = false;
+    }
+
+}
+
+void register_cache::invalidate() {
+    m_valid = false;
+    m_dirty = false;
+}
+
+uint64_t get_register_value_from_type(register_cache& regs, register_type type) {
+    return regs.get(type);
+}
+
+void set_register_value(register_cache& regs, register_type type, uint64_t value) {
+    regs.set(type, value);
 }
 
-uint64_t get_register_value_from_dwarf_register(pid_t pid, unsigned dwarf) {
+uint64_t get_register_value_from_dwarf_register(register_cache& regs, unsigned dwarf) {
     auto iter = find_if(begin(registers), end(registers), [dwarf](auto&& rg) { return rg.dwarf_reg_no==dwarf; });
 
     if(iter == end(registers)) {
         cerr<<"Out of bounds!!!\n";
     }
 
-    return get_register_value_from_type(pid, iter->r_type);
+    return get_register_value_from_type(regs, iter->r_type);
 }
 
 string get_register_name(register_type type) {
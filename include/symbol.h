@@ -1,3 +1,4 @@
+#include <fnmatch.h>
 #include <bits/stdc++.h>
 #include "../elf/elf++.hh"
 
@@ -38,6 +39,8 @@ symbol_type map_elf_symbol_to_struct_symbol_type(elf::stt type) {
             return symbol_type::file;
         case elf::stt::object:
             return symbol_type::object;
+        default:
+            return symbol_type::notype;
     }
 }
 
@@ -46,3 +49,309 @@ struct symbol {
     string name;
     uintptr_t address;
 };
+
+// Flat list of the symbols of the DYNSYM and SYMTAB sections. Names are views into the ELF string
+// tables (or into the on-disk index), so no string is built until a symbol is returned.
+// Exact lookups go through the .gnu.hash section for dynamic symbols when the binary has one, and
+// through an open addressing hash table for all other symbols. Prefix and glob queries use a sorted
+// array of the names.
+class symbol_table {
+
+    public:
+        struct entry {
+            string_view name;
+            uintptr_t address;
+            uint64_t size;
+            symbol_type type;
+        };
+
+        symbol_table() = default;
+
+        void build(const elf::elf& ef);
+        // Builds the hash indexes, the entries must be in build() order (dynamic symbols first)
+        void index(const elf::elf& ef);
+        // Finds the .gnu.hash section, which index() also does
+        void index_gnu_hash(const elf::elf& ef);
+
+        vector<symbol> lookup(const string& name) const;
+        vector<symbol> lookup_prefix(const string& prefix) const;
+        vector<symbol> lookup_glob(const string& pattern) const;
+        // Function or object symbol containing addr, nullptr if there is none
+        const entry* find_address(uintptr_t addr) const;
+
+        size_t size() const {
+            return m_entries.size();
+        }
+
+    private:
+        friend class index_cache;
+
+        static uint32_t gnu_hash(string_view name);
+        void lookup_gnu_hash(string_view name, uint32_t hash, vector<symbol>& out) const;
+        const vector<uint32_t>& get_sorted() const;
+        symbol to_symbol(const entry& sym) const {
+            return symbol{sym.type, string{sym.name}, sym.address};
+        }
+
+        vector<entry> m_entries;
+
+        // Open addressing table of entry positions + 1 (0 is an empty slot), its size is a power of two
+        mapped_array<uint32_t> m_slots;
+        mapped_array<uint32_t> m_hashes;
+
+        // .gnu.hash of the DYNSYM section, which covers entries [0, m_dynsym_count)
+        const uint32_t* m_gnu_hash = nullptr;
+        size_t m_gnu_hash_size = 0;
+        size_t m_dynsym_count = 0;
+
+        // Entry positions sorted by name, built on the first prefix or glob query
+        mutable vector<uint32_t> m_sorted;
+
+        // Function and object symbols sorted by address for reverse lookups
+        struct address_entry {
+            uintptr_t address;
+            uint64_t size;
+            uint32_t entry;
+        };
+        mapped_array<address_entry> m_by_address;
+
+};
+
+uint32_t symbol_table::gnu_hash(string_view name) {
+
+    uint32_t hash = 5381;
+    for(unsigned char c: name) {
+        hash = hash * 33 + c;
+    }
+    return hash;
+
+}
+
+void symbol_table::build(const elf::elf& ef) {
+
+    m_entries.clear();
+
+    // Dynamic symbols go first, their positions then match the symbol indexes used by .gnu.hash
+    for(auto table_type: {elf::sht::dynsym, elf::sht::symtab}) {
+        for(auto& section: ef.sections()) {
+            if (section.get_hdr().type != table_type) {
+                continue;
+            }
+
+            for(auto sym: section.as_symtab()) {
+                size_t len;
+                auto name = sym.get_name(&len);
+                auto& data = sym.get_data();
+                m_entries.push_back(entry{string_view{name, len}, data.value, data.size, map_elf_symbol_to_struct_symbol_type(data.type())});
+            }
+        }
+    }
+
+    index(ef);
+
+}
+
+void symbol_table::index(const elf::elf& ef) {
+
+    index_gnu_hash(ef);
+
+    size_t capacity = 16;
+    while(capacity < 2 * m_entries.size()) {
+        capacity *= 2;
+    }
+
+    auto& slots = m_slots.owned();
+    auto& hashes = m_hashes.owned();
+    slots.assign(capacity, 0);
+    hashes.assign(m_entries.size(), 0);
+
+    // Undefined dynamic symbols come before symoffset and are not part of .gnu.hash
+    size_t gnu_hashed_begin = (m_gnu_hash != nullptr) ? min<size_t>(m_gnu_hash[1], m_dynsym_count) : 0;
+
+    for(uint32_t i = 0; i < m_entries.size(); i++) {
+        if(m_entries[i].name.empty() || (i >= gnu_hashed_begin && i < m_dynsym_count)) {
+            continue;
+        }
+
+        hashes[i] = gnu_hash(m_entries[i].name);
+
+        auto slot = hashes[i] & (capacity - 1);
+        while(slots[slot] != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        slots[slot] = i + 1;
+    }
+
+    auto& by_address = m_by_address.owned();
+    by_address.clear();
+    for(uint32_t i = 0; i < m_entries.size(); i++) {
+        auto& sym = m_entries[i];
+        if(sym.address != 0 && !sym.name.empty() && (sym.type == symbol_type::func || sym.type == symbol_type::object)) {
+            by_address.push_back(address_entry{sym.address, sym.size, i});
+        }
+    }
+
+    // Aliases share an address, keep the first one with a size (functions before objects on ties)
+    stable_sort(by_address.begin(), by_address.end(), [this](const address_entry& a, const address_entry& b) {
+        if(a.address != b.address) {
+            return a.address < b.address;
+        }
+        if((a.size != 0) != (b.size != 0)) {
+            return a.size != 0;
+        }
+        return m_entries[a.entry].type == symbol_type::func && m_entries[b.entry].type != symbol_type::func;
+    });
+    by_address.erase(unique(by_address.begin(), by_address.end(), [](const address_entry& a, const address_entry& b) {
+        return a.address == b.address;
+    }), by_address.end());
+
+}
+
+void symbol_table::index_gnu_hash(const elf::elf& ef) {
+
+    m_gnu_hash = nullptr;
+    m_dynsym_count = 0;
+    m_sorted.clear();
+
+    for(auto& section: ef.sections()) {
+        if(section.get_hdr().type == elf::sht::dynsym) {
+            m_dynsym_count = section.size() / sizeof(elf::Sym<elf::Elf64>);
+        }
+    }
+
+    auto& gnu_hash_section = ef.get_section(".gnu.hash");
+    if(gnu_hash_section.valid() && gnu_hash_section.size() >= 16 && m_dynsym_count <= m_entries.size()) {
+        m_gnu_hash = static_cast<const uint32_t*>(gnu_hash_section.data());
+        m_gnu_hash_size = gnu_hash_section.size() / sizeof(uint32_t);
+    } else {
+        m_dynsym_count = 0;
+    }
+
+}
+
+// Walks the bloom filter, bucket and hash chain of .gnu.hash, see the GNU ELF hash section layout
+void symbol_table::lookup_gnu_hash(string_view name, uint32_t hash, vector<symbol>& out) const {
+
+    auto nbuckets = m_gnu_hash[0];
+    auto symoffset = m_gnu_hash[1];
+    auto bloom_size = m_gnu_hash[2];
+    auto bloom_shift = m_gnu_hash[3];
+
+    // The bloom filter words are 64-bit on ELF64
+    auto bloom = m_gnu_hash + 4;
+    auto buckets = bloom + 2 * bloom_size;
+    auto chain = buckets + nbuckets;
+    if(nbuckets == 0 || bloom_size == 0 || static_cast<size_t>(chain - m_gnu_hash) > m_gnu_hash_size) {
+        return;
+    }
+
+    uint64_t word;
+    memcpy(&word, bloom + 2 * ((hash / 64) % bloom_size), sizeof(word));
+    uint64_t mask = (1ull << (hash % 64)) | (1ull << ((hash >> bloom_shift) % 64));
+    if((word & mask) != mask) {
+        return;
+    }
+
+    auto index = buckets[hash % nbuckets];
+    if(index < symoffset) {
+        return;
+    }
+
+    for(; index < m_dynsym_count && static_cast<size_t>(chain + (index - symoffset) - m_gnu_hash) < m_gnu_hash_size; index++) {
+        auto chain_hash = chain[index - symoffset];
+
+        if((chain_hash | 1) == (hash | 1) && m_entries[index].name == name) {
+            out.push_back(to_symbol(m_entries[index]));
+        }
+
+        // The lowest bit marks the end of the chain
+        if(chain_hash & 1) {
+            break;
+        }
+    }
+
+}
+
+vector<symbol> symbol_table::lookup(const string& name) const {
+
+    vector<symbol> symbols;
+    auto hash = gnu_hash(name);
+
+    if(m_gnu_hash != nullptr) {
+        lookup_gnu_hash(name, hash, symbols);
+    }
+
+    if(m_slots.empty()) {
+        return symbols;
+    }
+
+    for(auto slot = hash & (m_slots.size() - 1); m_slots[slot] != 0; slot = (slot + 1) & (m_slots.size() - 1)) {
+        auto i = m_slots[slot] - 1;
+        if(m_hashes[i] == hash && m_entries[i].name == name) {
+            symbols.push_back(to_symbol(m_entries[i]));
+        }
+    }
+
+    return symbols;
+
+}
+
+const vector<uint32_t>& symbol_table::get_sorted() const {
+
+    if(m_sorted.empty() && !m_entries.empty()) {
+        m_sorted.resize(m_entries.size());
+        iota(m_sorted.begin(), m_sorted.end(), 0);
+        sort(m_sorted.begin(), m_sorted.end(), [this](uint32_t a, uint32_t b) { return m_entries[a].name < m_entries[b].name; });
+    }
+
+    return m_sorted;
+
+}
+
+vector<symbol> symbol_table::lookup_prefix(const string& prefix) const {
+
+    vector<symbol> symbols;
+    auto& sorted = get_sorted();
+
+    auto iter = lower_bound(sorted.begin(), sorted.end(), prefix, [this](uint32_t i, const string& value) { return m_entries[i].name < value; });
+
+    for(; iter != sorted.end() && m_entries[*iter].name.substr(0, prefix.size()) == prefix; iter++) {
+        symbols.push_back(to_symbol(m_entries[*iter]));
+    }
+
+    return symbols;
+
+}
+
+vector<symbol> symbol_table::lookup_glob(const string& pattern) const {
+
+    // Only the names starting with the literal part of the pattern need to be matched
+    auto literal_prefix = pattern.substr(0, pattern.find_first_of("*?["));
+
+    vector<symbol> symbols;
+    for(auto& sym: lookup_prefix(literal_prefix)) {
+        if(fnmatch(pattern.c_str(), sym.name.c_str(), 0) == 0) {
+            symbols.push_back(sym);
+        }
+    }
+
+    return symbols;
+
+}
+
+const symbol_table::entry* symbol_table::find_address(uintptr_t addr) const {
+
+    auto iter = upper_bound(m_by_address.begin(), m_by_address.end(), addr, [](uintptr_t value, const address_entry& e) { return value < e.address; });
+    if(iter == m_by_address.begin()) {
+        return nullptr;
+    }
+    iter--;
+
+    // Symbols without a size (e.g. from assembly) are taken to extend up to the next symbol
+    if(iter->size != 0 && addr >= iter->address + iter->size) {
+        return nullptr;
+    }
+
+    return &m_entries[iter->entry];
+
+}
@@ -0,0 +1,622 @@
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include <bits/stdc++.h>
+
+using namespace std;
+
+// x86-64 system calls and how their arguments are printed, one character per argument: d signed, u unsigned,
+// x hex, o octal, s string, b buffer whose length is the next argument. Calls without a signature print
+// all six argument registers in hex.
+struct syscall_desc {
+    long number;
+    const char* name;
+    const char* args;
+};
+
+// Sorted by number
+const syscall_desc syscall_table[] = {
+    {0, "read", "dxu"},
+    {1, "write", "dbu"},
+    {2, "open", "sxo"},
+    {3, "close", "d"},
+    {4, "stat", "sx"},
+    {5, "fstat", "dx"},
+    {6, "lstat", "sx"},
+    {7, "poll", "xud"},
+    {8, "lseek", "ddd"},
+    {9, "mmap", "xuxxdx"},
+    {10, "mprotect", "xux"},
+    {11, "munmap", "xu"},
+    {12, "brk", "x"},
+    {13, "rt_sigaction", "dxxu"},
+    {14, "rt_sigprocmask", "dxxu"},
+    {15, "rt_sigreturn", ""},
+    {16, "ioctl", "dxx"},
+    {17, "pread64", "dxud"},
+    {18, "pwrite64", "dbud"},
+    {19, "readv", "dxd"},
+    {20, "writev", "dxd"},
+    {21, "access", "so"},
+    {22, "pipe", "x"},
+    {23, "select", "dxxxx"},
+    {24, "sched_yield", ""},
+    {25, "mremap", "xuuxx"},
+    {26, "msync", "xux"},
+    {27, "mincore", "xux"},
+    {28, "madvise", "xud"},
+    {29, "shmget", "dud"},
+    {30, "shmat", "dxx"},
+    {31, "shmctl", "ddx"},
+    {32, "dup", "d"},
+    {33, "dup2", "dd"},
+    {34, "pause", ""},
+    {35, "nanosleep", "xx"},
+    {36, "getitimer", "dx"},
+    {37, "alarm", "u"},
+    {38, "setitimer", "dxx"},
+    {39, "getpid", ""},
+    {40, "sendfile", "ddxu"},
+    {41, "socket", "ddd"},
+    {42, "connect", "dxu"},
+    {43, "accept", "dxx"},
+    {44, "sendto", "dbuxxu"},
+    {45, "recvfrom", "dxuxxx"},
+    {46, "sendmsg", "dxx"},
+    {47, "recvmsg", "dxx"},
+    {48, "shutdown", "dd"},
+    {49, "bind", "dxu"},
+    {50, "listen", "dd"},
+    {51, "getsockname", "dxx"},
+    {52, "getpeername", "dxx"},
+    {53, "socketpair", "dddx"},
+    {54, "setsockopt", "dddxu"},
+    {55, "getsockopt", "dddxx"},
+    {56, "clone", "xxxxx"},
+    {57, "fork", ""},
+    {58, "vfork", ""},
+    {59, "execve", "sxx"},
+    {60, "exit", "d"},
+    {61, "wait4", "dxxx"},
+    {62, "kill", "dd"},
+    {63, "uname", "x"},
+    {64, "semget", nullptr},
+    {65, "semop", nullptr},
+    {66, "semctl", nullptr},
+    {67, "shmdt", "x"},
+    {68, "msgget", nullptr},
+    {69, "msgsnd", nullptr},
+    {70, "msgrcv", nullptr},
+    {71, "msgctl", nullptr},
+    {72, "fcntl", "ddx"},
+    {73, "flock", "dd"},
+    {74, "fsync", "d"},
+    {75, "fdatasync", "d"},
+    {76, "truncate", "sd"},
+    {77, "ftruncate", "dd"},
+    {78, "getdents", "dxu"},
+    {79, "getcwd", "xu"},
+    {80, "chdir", "s"},
+    {81, "fchdir", "d"},
+    {82, "rename", "ss"},
+    {83, "mkdir", "so"},
+    {84, "rmdir", "s"},
+    {85, "creat", "so"},
+    {86, "link", "ss"},
+    {87, "unlink", "s"},
+    {88, "symlink", "ss"},
+    {89, "readlink", "sxu"},
+    {90, "chmod", "so"},
+    {91, "fchmod", "do"},
+    {92, "chown", "sdd"},
+    {93, "fchown", "ddd"},
+    {94, "lchown", "sdd"},
+    {95, "umask", "o"},
+    {96, "gettimeofday", "xx"},
+    {97, "getrlimit", "dx"},
+    {98, "getrusage", "dx"},
+    {99, "sysinfo", "x"},
+    {100, "times", nullptr},
+    {101, "ptrace", "ddxx"},
+    {102, "getuid", ""},
+    {103, "syslog", nullptr},
+    {104, "getgid", ""},
+    {105, "setuid", "d"},
+    {106, "setgid", "d"},
+    {107, "geteuid", ""},
+    {108, "getegid", ""},
+    {109, "setpgid", "dd"},
+    {110, "getppid", ""},
+    {111, "getpgrp", ""},
+    {112, "setsid", ""},
+    {113, "setreuid", nullptr},
+    {114, "setregid", nullptr},
+    {115, "getgroups", nullptr},
+    {116, "setgroups", nullptr},
+    {117, "setresuid", "ddd"},
+    {118, "getresuid", "xxx"},
+    {119, "setresgid", "ddd"},
+    {120, "getresgid", "xxx"},
+    {121, "getpgid", "d"},
+    {122, "setfsuid", nullptr},
+    {123, "setfsgid", nullptr},
+    {124, "getsid", "d"},
+    {125, "capget", nullptr},
+    {126, "capset", nullptr},
+    {127, "rt_sigpending", "xu"},
+    {128, "rt_sigtimedwait", "xxxu"},
+    {129, "rt_sigqueueinfo", "ddx"},
+    {130, "rt_sigsuspend", "xu"},
+    {131, "sigaltstack", "xx"},
+    {132, "utime", nullptr},
+    {133, "mknod", nullptr},
+    {134, "uselib", nullptr},
+    {135, "personality", "x"},
+    {136, "ustat", nullptr},
+    {137, "statfs", "sx"},
+    {138, "fstatfs", "dx"},
+    {139, "sysfs", nullptr},
+    {140, "getpriority", "dd"},
+    {141, "setpriority", "ddd"},
+    {142, "sched_setparam", nullptr},
+    {143, "sched_getparam", nullptr},
+    {144, "sched_setscheduler", "dxd"},
+    {145, "sched_getscheduler", "d"},
+    {146, "sched_get_priority_max", nullptr},
+    {147, "sched_get_priority_min", nullptr},
+    {148, "sched_rr_get_interval", nullptr},
+    {149, "mlock", "xu"},
+    {150, "munlock", "xu"},
+    {151, "mlockall", "x"},
+    {152, "munlockall", ""},
+    {153, "vhangup", nullptr},
+    {154, "modify_ldt", nullptr},
+    {155, "pivot_root", nullptr},
+    {156, "_sysctl", nullptr},
+    {157, "prctl", "dxxxx"},
+    {158, "arch_prctl", "dx"},
+    {159, "adjtimex", nullptr},
+    {160, "setrlimit", nullptr},
+    {161, "chroot", "s"},
+    {162, "sync", ""},
+    {163, "acct", nullptr},
+    {164, "settimeofday", nullptr},
+    {165, "mount", "sssxx"},
+    {166, "umount2", "sx"},
+    {167, "swapon", nullptr},
+    {168, "swapoff", nullptr},
+    {169, "reboot", "ddxx"},
+    {170, "sethostname", "su"},
+    {171, "setdomainname", nullptr},
+    {172, "iopl", nullptr},
+    {173, "ioperm", nullptr},
+    {174, "create_module", nullptr},
+    {175, "init_module", nullptr},
+    {176, "delete_module", nullptr},
+    {177, "get_kernel_syms", nullptr},
+    {178, "query_module", nullptr},
+    {179, "quotactl", nullptr},
+    {180, "nfsservctl", nullptr},
+    {181, "getpmsg", nullptr},
+    {182, "putpmsg", nullptr},
+    {183, "afs_syscall", nullptr},
+    {184, "tuxcall", nullptr},
+    {185, "security", nullptr},
+    {186, "gettid", ""},
+    {187, "readahead", nullptr},
+    {188, "setxattr", nullptr},
+    {189, "lsetxattr", nullptr},
+    {190, "fsetxattr", nullptr},
+    {191, "getxattr", nullptr},
+    {192, "lgetxattr", nullptr},
+    {193, "fgetxattr", nullptr},
+    {194, "listxattr", nullptr},
+    {195, "llistxattr", nullptr},
+    {196, "flistxattr", nullptr},
+    {197, "removexattr", nullptr},
+    {198, "lremovexattr", nullptr},
+    {199, "fremovexattr", nullptr},
+    {200, "tkill", "dd"},
+    {201, "time", "x"},
+    {202, "futex", "xddxxd"},
+    {203, "sched_setaffinity", "dux"},
+    {204, "sched_getaffinity", "dux"},
+    {205, "set_thread_area", nullptr},
+    {206, "io_setup", nullptr},
+    {207, "io_destroy", nullptr},
+    {208, "io_getevents", nullptr},
+    {209, "io_submit", nullptr},
+    {210, "io_cancel", nullptr},
+    {211, "get_thread_area", nullptr},
+    {212, "lookup_dcookie", nullptr},
+    {213, "epoll_create", "d"},
+    {214, "epoll_ctl_old", nullptr},
+    {215, "epoll_wait_old", nullptr},
+    {216, "remap_file_pages", nullptr},
+    {217, "getdents64", "dxu"},
+    {218, "set_tid_address", "x"},
+    {219, "restart_syscall", ""},
+    {220, "semtimedop", nullptr},
+    {221, "fadvise64", "dddd"},
+    {222, "timer_create", "dxx"},
+    {223, "timer_settime", "dxxx"},
+    {224, "timer_gettime", "dx"},
+    {225, "timer_getoverrun", "d"},
+    {226, "timer_delete", "d"},
+    {227, "clock_settime", nullptr},
+    {228, "clock_gettime", "dx"},
+    {229, "clock_getres", "dx"},
+    {230, "clock_nanosleep", "ddxx"},
+    {231, "exit_group", "d"},
+    {232, "epoll_wait", "dxdd"},
+    {233, "epoll_ctl", "dddx"},
+    {234, "tgkill", "ddd"},
+    {235, "utimes", nullptr},
+    {236, "vserver", nullptr},
+    {237, "mbind", nullptr},
+    {238, "set_mempolicy", nullptr},
+    {239, "get_mempolicy", nullptr},
+    {240, "mq_open", nullptr},
+    {241, "mq_unlink", nullptr},
+    {242, "mq_timedsend", nullptr},
+    {243, "mq_timedreceive", nullptr},
+    {244, "mq_notify", nullptr},
+    {245, "mq_getsetattr", nullptr},
+    {246, "kexec_load", nullptr},
+    {247, "waitid", "ddxdx"},
+    {248, "add_key", nullptr},
+    {249, "request_key", nullptr},
+    {250, "keyctl", nullptr},
+    {251, "ioprio_set", nullptr},
+    {252, "ioprio_get", nullptr},
+    {253, "inotify_init", ""},
+    {254, "inotify_add_watch", "dsx"},
+    {255, "inotify_rm_watch", "dd"},
+    {256, "migrate_pages", nullptr},
+    {257, "openat", "dsxo"},
+    {258, "mkdirat", "dso"},
+    {259, "mknodat", "dsox"},
+    {260, "fchownat", "dsddx"},
+    {261, "futimesat", nullptr},
+    {262, "newfstatat", "dsxx"},
+    {263, "unlinkat", "dsx"},
+    {264, "renameat", "dsds"},
+    {265, "linkat", "dsdsx"},
+    {266, "symlinkat", "sds"},
+    {267, "readlinkat", "dsxu"},
+    {268, "fchmodat", "dso"},
+    {269, "faccessat", "dso"},
+    {270, "pselect6", "dxxxxx"},
+    {271, "ppoll", "xuxxu"},
+    {272, "unshare", "x"},
+    {273, "set_robust_list", "xu"},
+    {274, "get_robust_list", "dxx"},
+    {275, "splice", "dxdxux"},
+    {276, "tee", "ddux"},
+    {277, "sync_file_range", nullptr},
+    {278, "vmsplice", nullptr},
+    {279, "move_pages", nullptr},
+    {280, "utimensat", "dsxx"},
+    {281, "epoll_pwait", "dxddxu"},
+    {282, "signalfd", nullptr},
+    {283, "timerfd_create", "dx"},
+    {284, "eventfd", "u"},
+    {285, "fallocate", "dddd"},
+    {286, "timerfd_settime", "dxxx"},
+    {287, "timerfd_gettime", "dx"},
+    {288, "accept4", "dxxx"},
+    {289, "signalfd4", "dxux"},
+    {290, "eventfd2", "ux"},
+    {291, "epoll_create1", "x"},
+    {292, "dup3", "ddx"},
+    {293, "pipe2", "xx"},
+    {294, "inotify_init1", "x"},
+    {295, "preadv", "dxdd"},
+    {296, "pwritev", "dxdd"},
+    {297, "rt_tgsigqueueinfo", nullptr},
+    {298, "perf_event_open", "xdddx"},
+    {299, "recvmmsg", "dxuxx"},
+    {300, "fanotify_init", nullptr},
+    {301, "fanotify_mark", nullptr},
+    {302, "prlimit64", "ddxx"},
+    {303, "name_to_handle_at", nullptr},
+    {304, "open_by_handle_at", nullptr},
+    {305, "clock_adjtime", nullptr},
+    {306, "syncfs", "d"},
+    {307, "sendmmsg", "dxux"},
+    {308, "setns", "dd"},
+    {309, "getcpu", "xxx"},
+    {310, "process_vm_readv", "dxuxux"},
+    {311, "process_vm_writev", "dxuxux"},
+    {312, "kcmp", "dddxx"},
+    {313, "finit_module", nullptr},
+    {314, "sched_setattr", "dxu"},
+    {315, "sched_getattr", "dxuu"},
+    {316, "renameat2", "dsdsx"},
+    {317, "seccomp", "uxx"},
+    {318, "getrandom", "xux"},
+    {319, "memfd_create", "sx"},
+    {320, "kexec_file_load", nullptr},
+    {321, "bpf", "dxu"},
+    {322, "execveat", "dsxxx"},
+    {323, "userfaultfd", "x"},
+    {324, "membarrier", "dxd"},
+    {325, "mlock2", nullptr},
+    {326, "copy_file_range", "dxdxux"},
+    {327, "preadv2", "dxddx"},
+    {328, "pwritev2", "dxddx"},
+    {329, "pkey_mprotect", nullptr},
+    {330, "pkey_alloc", nullptr},
+    {331, "pkey_free", nullptr},
+    {332, "statx", "dsxxx"},
+    {333, "io_pgetevents", nullptr},
+    {334, "rseq", "xuxx"},
+    {424, "pidfd_send_signal", "ddxx"},
+    {425, "io_uring_setup", "ux"},
+    {426, "io_uring_enter", "duuxxu"},
+    {427, "io_uring_register", "duxu"},
+    {428, "open_tree", nullptr},
+    {429, "move_mount", nullptr},
+    {430, "fsopen", nullptr},
+    {431, "fsconfig", nullptr},
+    {432, "fsmount", nullptr},
+    {433, "fspick", nullptr},
+    {434, "pidfd_open", "dx"},
+    {435, "clone3", "xu"},
+    {436, "close_range", "uux"},
+    {437, "openat2", "dsxu"},
+    {438, "pidfd_getfd", "ddx"},
+    {439, "faccessat2", "dsox"},
+    {440, "process_madvise", nullptr},
+    {441, "epoll_pwait2", "dxdxxu"},
+    {442, "mount_setattr", nullptr},
+    {443, "quotactl_fd", nullptr},
+    {444, "landlock_create_ruleset", "xux"},
+    {445, "landlock_add_rule", nullptr},
+    {446, "landlock_restrict_self", nullptr},
+    {447, "memfd_secret", nullptr},
+    {448, "process_mrelease", nullptr},
+    {449, "futex_waitv", nullptr},
+    {450, "set_mempolicy_home_node", nullptr},
+};
+
+const syscall_desc* find_syscall(long number) {
+
+    auto iter = lower_bound(begin(syscall_table), end(syscall_table), number, [](const syscall_desc& desc, long value) {
+        return desc.number < value;
+    });
+    return (iter != end(syscall_table) && iter->number == number) ? &*iter : nullptr;
+
+}
+
+// Name or number, -1 if there is no such system call
+long find_syscall_number(const string& name) {
+
+    if(!name.empty() && all_of(name.begin(), name.end(), ::isdigit)) {
+        return stol(name);
+    }
+
+    auto iter = find_if(begin(syscall_table), end(syscall_table), [&name](const syscall_desc& desc) {
+        return name == desc.name;
+    });
+    return iter != end(syscall_table) ? iter->number : -1;
+
+}
+
+string get_syscall_name(long number) {
+    auto desc = find_syscall(number);
+    return desc ? desc->name : "syscall_" + to_string(number);
+}
+
+// Arguments are passed in rdi, rsi, rdx, r10, r8 and r9, the number in orig_rax and the result in rax
+array<uint64_t, 6> get_syscall_args(register_cache& regs) {
+    return {regs.get(register_type::rdi), regs.get(register_type::rsi), regs.get(register_type::rdx),
+            regs.get(register_type::r10), regs.get(register_type::r8), regs.get(register_type::r9)};
+}
+
+// Quoted and escaped like strace, at most 32 bytes. Strings stop at their terminating zero, buffers don't.
+string format_tracee_string(memory_cache& memory, uint64_t addr, size_t len, bool zero_terminated) {
+
+    constexpr size_t max_len = 32;
+
+    if(addr == 0) {
+        return "NULL";
+    }
+
+    string data;
+    bool complete = false;
+    while(data.size() < min(len, max_len + 1) && !complete) {
+        char chunk[max_len + 1];
+        auto size = min<uint64_t>({sizeof(chunk), min(len, max_len + 1) - data.size(),
+                                   memory_cache::page_size - (addr & (memory_cache::page_size - 1))});
+        if(!memory.read(addr, chunk, size)) {
+            break;
+        }
+
+        auto end = zero_terminated ? find(chunk, chunk + size, '\0') : chunk + size;
+        data.append(chunk, end);
+        complete = end != chunk + size;
+        addr += size;
+    }
+
+    if(data.empty() && !complete && len != 0) {
+        char buffer[24];
+        snprintf(buffer, sizeof(buffer), "0x%" PRIx64, addr);
+        return buffer;
+    }
+
+    string result = "\"";
+    for(size_t i = 0; i < min(data.size(), max_len); i++) {
+        auto c = static_cast<unsigned char>(data[i]);
+        switch(c) {
+            case '\n': result += "\\n"; break;
+            case '\t': result += "\\t"; break;
+            case '"': result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            default:
+                if(isprint(c)) {
+                    result += c;
+                } else {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\%o", c);
+                    result += escaped;
+                }
+        }
+    }
+    result += "\"";
+    if(data.size() > max_len) {
+        result += "...";
+    }
+    return result;
+
+}
+
+string format_syscall_args(long number, const array<uint64_t, 6>& args, memory_cache& memory) {
+
+    auto desc = find_syscall(number);
+    const char* signature = (desc && desc->args) ? desc->args : "xxxxxx";
+
+    string result;
+    char buffer[32];
+
+    for(size_t i = 0; signature[i] != '\0' && i < args.size(); i++) {
+        if(i != 0) {
+            result += ", ";
+        }
+
+        auto value = args[i];
+        switch(signature[i]) {
+            case 'd':
+                snprintf(buffer, sizeof(buffer), "%d", static_cast<int>(value));
+                break;
+            case 'u':
+                snprintf(buffer, sizeof(buffer), "%" PRIu64, value);
+                break;
+            case 'o':
+                snprintf(buffer, sizeof(buffer), "0%" PRIo64, value);
+                break;
+            case 's':
+                result += format_tracee_string(memory, value, SIZE_MAX, true);
+                continue;
+            case 'b':
+                result += format_tracee_string(memory, value, i + 1 < args.size() ? args[i + 1] : 0, false);
+                continue;
+            default:
+                snprintf(buffer, sizeof(buffer), "0x%" PRIx64, value);
+                break;
+        }
+        result += buffer;
+    }
+
+    return result;
+
+}
+
+// -4095 to -1 are errors, addresses are printed in hex
+string format_syscall_result(int64_t result) {
+
+    char buffer[96];
+    if(result < 0 && result >= -4095) {
+        snprintf(buffer, sizeof(buffer), "-1 (%s)", strerror(-result));
+    } else if(result > INT32_MAX) {
+        snprintf(buffer, sizeof(buffer), "0x%" PRIx64, static_cast<uint64_t>(result));
+    } else {
+        snprintf(buffer, sizeof(buffer), "%" PRId64, result);
+    }
+    return buffer;
+
+}
+
+// Calls, errors and time between the entry and exit stops of every system call, printed like strace -c
+class syscall_stats {
+
+    public:
+        syscall_stats() = default;
+
+        void record(long number, chrono::nanoseconds time, int64_t result) {
+            auto& entry = m_entries[number];
+            entry.calls++;
+            entry.time += time;
+            if(result < 0 && result >= -4095) {
+                entry.errors++;
+            }
+        }
+
+        void print() const;
+
+        void clear() {
+            m_entries.clear();
+        }
+
+    private:
+        struct entry {
+            uint64_t calls = 0;
+            uint64_t errors = 0;
+            chrono::nanoseconds time{0};
+        };
+
+        unordered_map<long, entry> m_entries;
+
+};
+
+void syscall_stats::print() const {
+
+    vector<pair<long, entry>> sorted(m_entries.begin(), m_entries.end());
+    sort(sorted.begin(), sorted.end(), [](auto&& a, auto&& b) {
+        return a.second.time > b.second.time;
+    });
+
+    chrono::nanoseconds total{0};
+    uint64_t calls = 0;
+    uint64_t errors = 0;
+    for(auto& [number, stats]: sorted) {
+        total += stats.time;
+        calls += stats.calls;
+        errors += stats.errors;
+    }
+
+    auto print_row = [total](chrono::nanoseconds time, uint64_t calls, uint64_t errors, const string& name) {
+        cout<<fixed<<setprecision(2)<<setw(6)<<(total.count() ? 100.0 * time.count() / total.count() : 0.0)
+            <<setprecision(6)<<setw(12)<<time.count() / 1e9<<setw(12)<<(calls ? time.count() / 1000 / calls : 0)
+            <<setw(10)<<calls<<setw(10)<<errors<<" "<<name<<defaultfloat<<endl;
+    };
+
+    cout<<dec<<setw(6)<<"% time"<<setw(12)<<"seconds"<<setw(12)<<"usecs/call"<<setw(10)<<"calls"<<setw(10)<<"errors"<<" syscall"<<endl;
+    for(auto& [number, stats]: sorted) {
+        print_row(stats.time, stats.calls, stats.errors, get_syscall_name(number));
+    }
+    print_row(total, calls, errors, "total");
+
+}
+
+// Filter for the tracee: the listed system calls stop it with PTRACE_EVENT_SECCOMP, the others run without
+// the tracer. It has to be installed by the tracee itself after the tracer attached, a traced call fails
+// with ENOSYS when no tracer is attached.
+vector<sock_filter> build_seccomp_filter(const set<long>& numbers) {
+
+    vector<sock_filter> filter {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)),
+    };
+
+    for(auto number: numbers) {
+        filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>(number), 0, 1));
+        filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+    }
+    filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+
+    return filter;
+
+}
+
+bool install_seccomp_filter(vector<sock_filter>& filter) {
+
+    sock_fprog program {static_cast<unsigned short>(filter.size()), filter.data()};
+
+    // Required to install a filter without CAP_SYS_ADMIN
+    return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 && prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) == 0;
+
+}
@@ -0,0 +1,29 @@
+#include <signal.h>
+#include <sys/types.h>
+#include <bits/stdc++.h>
+
+using namespace std;
+
+// A thread of the tracee with its own register snapshot and stop state
+struct tracee_thread {
+    tracee_thread(pid_t tid) : tid{tid}, registers{tid} {}
+
+    pid_t tid;
+    register_cache registers;
+
+    bool stopped = false;
+    // A SIGSTOP is on its way, either sent by the debugger or the first stop of a new thread
+    bool stop_requested = false;
+    // Signal to deliver when the thread resumes
+    int pending_signal = 0;
+    // A stop collected while the debugger was waiting for another thread, reported at the next continue
+    bool has_pending_event = false;
+    siginfo_t pending_event;
+
+    // Between the entry and exit stops of a system call, with PTRACE_SYSCALL or a seccomp filter
+    bool in_syscall = false;
+    long syscall_number = -1;
+    chrono::steady_clock::time_point syscall_start;
+    // Formatted at the entry, strings can be gone by the exit
+    string syscall_args;
+};
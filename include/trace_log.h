@@ -0,0 +1,345 @@
+#include <bits/stdc++.h>
+
+using namespace std;
+
+// Events of the tracepoints, recorded by the debugger thread into a ring buffer and written to a binary
+// file by a writer thread, so that a tracepoint hit costs no formatting and no syscall.
+//
+// File layout, little endian: "DBGTRACE" and a uint32_t version, then entries starting with a uint8_t type.
+//   definition: uint32_t id, uint64_t address, string format, uint8_t argument count, string arguments...
+//   event:      uint32_t id, uint32_t tid, uint64_t nanoseconds since the start, uint8_t count, int64_t values...
+// Strings are a uint16_t length followed by the bytes.
+class trace_log {
+
+    public:
+        static constexpr size_t max_values = 8;
+
+        struct event {
+            uint32_t id;
+            uint32_t tid;
+            uint64_t time;
+            uint8_t count;
+            int64_t values[max_values];
+        };
+
+        struct definition {
+            uint32_t id;
+            uint64_t address;
+            string format;
+            vector<string> arguments;
+        };
+
+        trace_log() = default;
+        trace_log(const trace_log&) = delete;
+        trace_log& operator=(const trace_log&) = delete;
+        ~trace_log();
+
+        bool open(const string& path);
+        bool is_open() const {
+            return m_file != nullptr;
+        }
+        const string& get_path() const {
+            return m_path;
+        }
+
+        // Definitions are written before the first event of the tracepoint
+        void define(definition tracepoint);
+
+        // Called by the debugger thread only. The event is dropped if the writer is behind by a whole buffer.
+        bool record(const event& e);
+
+        // Waits for the writer to write everything recorded so far
+        void flush();
+        void close();
+
+        uint64_t get_recorded() const {
+            return m_recorded;
+        }
+        uint64_t get_dropped() const {
+            return m_dropped;
+        }
+        uint64_t get_written() const {
+            return m_written;
+        }
+
+        // printf-like formatting of the values, %d %i %u %x %p %c and %%
+        static string format(const string& fmt, const int64_t* values, size_t count);
+        // Reads a trace file back, the callback gets every event with the definition of its tracepoint
+        static bool read(const string& path, const function<void(const definition&, const event&)>& callback);
+
+    private:
+        static constexpr size_t capacity = 1 << 16;
+
+        void writer();
+        void write_definitions();
+        void write_string(const string& text);
+
+        string m_path;
+        FILE* m_file = nullptr;
+        thread m_writer;
+
+        // Single producer and single consumer, positions only grow and are taken modulo the capacity
+        vector<event> m_buffer;
+        atomic<uint64_t> m_head{0};
+        atomic<uint64_t> m_tail{0};
+
+        mutex m_mutex;
+        condition_variable m_wake;
+        condition_variable m_drained;
+        bool m_stop = false;
+        vector<definition> m_definitions;
+        size_t m_definitions_written = 0;
+
+        uint64_t m_recorded = 0;
+        uint64_t m_dropped = 0;
+        atomic<uint64_t> m_written{0};
+
+};
+
+trace_log::~trace_log() {
+    close();
+}
+
+bool trace_log::open(const string& path) {
+
+    m_file = fopen(path.c_str(), "wb");
+    if(m_file == nullptr) {
+        return false;
+    }
+
+    m_path = path;
+    m_buffer.resize(capacity);
+    m_stop = false;
+
+    uint32_t version = 1;
+    fwrite("DBGTRACE", 1, 8, m_file);
+    fwrite(&version, sizeof(version), 1, m_file);
+
+    m_writer = thread{[this]() {
+        writer();
+    }};
+
+    return true;
+
+}
+
+void trace_log::define(definition tracepoint) {
+    lock_guard<mutex> lock{m_mutex};
+    m_definitions.push_back(move(tracepoint));
+}
+
+bool trace_log::record(const event& e) {
+
+    auto head = m_head.load(memory_order_relaxed);
+    if(head - m_tail.load(memory_order_acquire) == capacity) {
+        m_dropped++;
+        return false;
+    }
+
+    m_buffer[head % capacity] = e;
+    m_head.store(head + 1, memory_order_release);
+    m_recorded++;
+
+    // The writer sleeps between batches, only a filling buffer wakes it early
+    if(head % (capacity / 4) == 0) {
+        m_wake.notify_one();
+    }
+    return true;
+
+}
+
+void trace_log::writer() {
+
+    while(true) {
+        auto head = m_head.load(memory_order_acquire);
+
+        // An event is recorded after the definition of its tracepoint, so loading the head first is enough
+        {
+            lock_guard<mutex> lock{m_mutex};
+            write_definitions();
+        }
+
+        auto tail = m_tail.load(memory_order_relaxed);
+        for(; tail != head; tail++) {
+            auto& e = m_buffer[tail % capacity];
+            uint8_t type = 1;
+            fwrite(&type, 1, 1, m_file);
+            fwrite(&e.id, sizeof(e.id), 1, m_file);
+            fwrite(&e.tid, sizeof(e.tid), 1, m_file);
+            fwrite(&e.time, sizeof(e.time), 1, m_file);
+            fwrite(&e.count, 1, 1, m_file);
+            fwrite(e.values, sizeof(int64_t), e.count, m_file);
+        }
+        m_written += tail - m_tail.load(memory_order_relaxed);
+        m_tail.store(tail, memory_order_release);
+
+        unique_lock<mutex> lock{m_mutex};
+        if(tail == m_head.load(memory_order_acquire)) {
+            fflush(m_file);
+            m_drained.notify_all();
+            if(m_stop) {
+                return;
+            }
+            m_wake.wait_for(lock, chrono::milliseconds{10});
+        }
+    }
+
+}
+
+void trace_log::write_definitions() {
+
+    for(; m_definitions_written < m_definitions.size(); m_definitions_written++) {
+        auto& tracepoint = m_definitions[m_definitions_written];
+        uint8_t type = 0;
+        uint8_t count = tracepoint.arguments.size();
+        fwrite(&type, 1, 1, m_file);
+        fwrite(&tracepoint.id, sizeof(tracepoint.id), 1, m_file);
+        fwrite(&tracepoint.address, sizeof(tracepoint.address), 1, m_file);
+        write_string(tracepoint.format);
+        fwrite(&count, 1, 1, m_file);
+        for(auto& argument: tracepoint.arguments) {
+            write_string(argument);
+        }
+    }
+
+}
+
+void trace_log::write_string(const string& text) {
+    uint16_t size = min<size_t>(text.size(), UINT16_MAX);
+    fwrite(&size, sizeof(size), 1, m_file);
+    fwrite(text.data(), 1, size, m_file);
+}
+
+void trace_log::flush() {
+
+    if(!is_open()) {
+        return;
+    }
+
+    unique_lock<mutex> lock{m_mutex};
+    m_wake.notify_one();
+    m_drained.wait(lock, [this]() {
+        return m_tail.load(memory_order_acquire) == m_head.load(memory_order_acquire) && m_definitions_written == m_definitions.size();
+    });
+
+}
+
+void trace_log::close() {
+
+    if(!is_open()) {
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock{m_mutex};
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_writer.join();
+
+    fclose(m_file);
+    m_file = nullptr;
+
+}
+
+string trace_log::format(const string& fmt, const int64_t* values, size_t count) {
+
+    string result;
+    size_t next = 0;
+    char buffer[32];
+
+    for(size_t i = 0; i < fmt.size(); i++) {
+        if(fmt[i] != '%' || i + 1 == fmt.size()) {
+            result += fmt[i];
+            continue;
+        }
+
+        auto conversion = fmt[++i];
+        if(conversion == '%') {
+            result += '%';
+            continue;
+        }
+        if(next == count) {
+            result += "<missing>";
+            continue;
+        }
+
+        auto value = values[next++];
+        switch(conversion) {
+            case 'u':
+                snprintf(buffer, sizeof(buffer), "%" PRIu64, static_cast<uint64_t>(value));
+                break;
+            case 'x':
+                snprintf(buffer, sizeof(buffer), "%" PRIx64, static_cast<uint64_t>(value));
+                break;
+            case 'p':
+                snprintf(buffer, sizeof(buffer), "0x%" PRIx64, static_cast<uint64_t>(value));
+                break;
+            case 'c':
+                snprintf(buffer, sizeof(buffer), "%c", static_cast<char>(value));
+                break;
+            default:
+                snprintf(buffer, sizeof(buffer), "%" PRId64, value);
+                break;
+        }
+        result += buffer;
+    }
+
+    return result;
+
+}
+
+bool trace_log::read(const string& path, const function<void(const definition&, const event&)>& callback) {
+
+    ifstream in(path, ios::binary);
+    char magic[8];
+    uint32_t version;
+    if(!in.read(magic, sizeof(magic)) || memcmp(magic, "DBGTRACE", sizeof(magic)) != 0 ||
+       !in.read(reinterpret_cast<char*>(&version), sizeof(version)) || version != 1) {
+        return false;
+    }
+
+    auto read_string = [&in]() {
+        uint16_t size = 0;
+        in.read(reinterpret_cast<char*>(&size), sizeof(size));
+        string text(size, '\0');
+        in.read(&text[0], size);
+        return text;
+    };
+
+    unordered_map<uint32_t, definition> definitions;
+    uint8_t type;
+
+    while(in.read(reinterpret_cast<char*>(&type), 1)) {
+        if(type == 0) {
+            definition tracepoint;
+            uint8_t count = 0;
+            in.read(reinterpret_cast<char*>(&tracepoint.id), sizeof(tracepoint.id));
+            in.read(reinterpret_cast<char*>(&tracepoint.address), sizeof(tracepoint.address));
+            tracepoint.format = read_string();
+            in.read(reinterpret_cast<char*>(&count), 1);
+            for(unsigned i = 0; i < count; i++) {
+                tracepoint.arguments.push_back(read_string());
+            }
+            definitions[tracepoint.id] = move(tracepoint);
+            continue;
+        }
+
+        event e;
+        in.read(reinterpret_cast<char*>(&e.id), sizeof(e.id));
+        in.read(reinterpret_cast<char*>(&e.tid), sizeof(e.tid));
+        in.read(reinterpret_cast<char*>(&e.time), sizeof(e.time));
+        in.read(reinterpret_cast<char*>(&e.count), 1);
+        e.count = min<uint8_t>(e.count, max_values);
+        in.read(reinterpret_cast<char*>(e.values), e.count * sizeof(int64_t));
+
+        auto tracepoint = definitions.find(e.id);
+        if(!in || tracepoint == definitions.end()) {
+            return false;
+        }
+        callback(tracepoint->second, e);
+    }
+
+    return true;
+
+}
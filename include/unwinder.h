@@ -0,0 +1,669 @@
+#include <bits/stdc++.h>
+#include "../elf/elf++.hh"
+
+using namespace std;
+
+// Registers tracked while unwinding, indexed by their x86-64 DWARF number (0-15), 16 is the return address
+struct unwind_registers {
+    static constexpr unsigned count = 17;
+    static constexpr unsigned rbp = 6;
+    static constexpr unsigned rsp = 7;
+    static constexpr unsigned return_address = 16;
+
+    array<uint64_t, count> values{};
+    bitset<count> known;
+};
+
+// Call frame information unwinder over .eh_frame and .debug_frame. All CIEs and FDEs are parsed into a table
+// sorted by PC when the first frame is unwound, and the CFA/register rules computed for a PC are cached, so
+// that repeated backtraces don't run the CFA programs again.
+class cfi_unwinder {
+
+    public:
+        cfi_unwinder() = default;
+
+        // The sections are only read by the first step()
+        void build(const elf::elf& ef);
+
+        // Replaces the registers of a frame by those of its caller, pc and addresses are runtime addresses.
+        // The PC of every frame except the innermost one is a return address, which can be one past the
+        // end of the calling function, so it is looked up one byte before.
+        bool step(unwind_registers& regs, memory_cache& memory, uint64_t load_address, bool innermost);
+
+        size_t get_cached_rows() {
+            return m_rows.size();
+        }
+
+    private:
+        struct cie {
+            uint64_t code_align;
+            int64_t data_align;
+            unsigned return_register;
+            uint8_t pointer_encoding;
+            bool is_eh;
+            const uint8_t* instructions;
+            const uint8_t* instructions_end;
+        };
+
+        struct fde {
+            uint64_t pc_begin;
+            uint64_t pc_end;
+            size_t cie;
+            const uint8_t* instructions;
+            const uint8_t* instructions_end;
+        };
+
+        struct rule {
+            enum kind_type { same_value, undefined, offset, val_offset, reg, unsupported } kind;
+            int64_t value;
+        };
+
+        struct row {
+            unsigned cfa_register;
+            int64_t cfa_offset;
+            bool cfa_supported;
+            array<rule, unwind_registers::count> rules;
+        };
+
+        // Reads a section of CIEs and FDEs. base_addr is the address of the section when it is loaded,
+        // used by the PC-relative pointers of .eh_frame.
+        void read_section(const uint8_t* data, size_t size, uint64_t base_addr, bool is_eh);
+        bool read_cie(const uint8_t* start, const uint8_t* end, bool is_eh, cie* out);
+
+        const row* find_row(uint64_t pc);
+        bool run_program(const uint8_t* pos, const uint8_t* end, const cie& c, uint64_t target, uint64_t* loc, row& current, const row& initial);
+
+        static uint64_t read_uleb(const uint8_t*& pos, const uint8_t* end);
+        static int64_t read_sleb(const uint8_t*& pos, const uint8_t* end);
+        uint64_t read_pointer(const uint8_t*& pos, const uint8_t* end, uint8_t encoding, bool relative_allowed);
+
+        void read_sections();
+
+        elf::elf m_elf;
+        bool m_read = false;
+        vector<cie> m_cies;
+        vector<fde> m_fdes;
+        unordered_map<uint64_t, row> m_rows;
+
+        // Used to resolve PC-relative pointers while reading .eh_frame
+        const uint8_t* m_section_data = nullptr;
+        uint64_t m_section_addr = 0;
+
+};
+
+uint64_t cfi_unwinder::read_uleb(const uint8_t*& pos, const uint8_t* end) {
+
+    uint64_t result = 0;
+    unsigned shift = 0;
+    while(pos < end) {
+        auto byte = *pos++;
+        if(shift < 64) {
+            result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        }
+        shift += 7;
+        if(!(byte & 0x80)) {
+            break;
+        }
+    }
+    return result;
+
+}
+
+int64_t cfi_unwinder::read_sleb(const uint8_t*& pos, const uint8_t* end) {
+
+    int64_t result = 0;
+    unsigned shift = 0;
+    uint8_t byte = 0;
+    while(pos < end) {
+        byte = *pos++;
+        if(shift < 64) {
+            result |= static_cast<int64_t>(byte & 0x7f) << shift;
+        }
+        shift += 7;
+        if(!(byte & 0x80)) {
+            break;
+        }
+    }
+    if(shift < 64 && (byte & 0x40)) {
+        result |= -(static_cast<int64_t>(1) << shift);
+    }
+    return result;
+
+}
+
+// Reads a pointer encoded with a DW_EH_PE_* encoding: the low nibble is the format, the next one the base
+uint64_t cfi_unwinder::read_pointer(const uint8_t*& pos, const uint8_t* end, uint8_t encoding, bool relative_allowed) {
+
+    if(encoding == 0xff) {
+        return 0;
+    }
+
+    auto field_addr = m_section_addr + (pos - m_section_data);
+    uint64_t value = 0;
+
+    auto read_fixed = [&](size_t size, bool is_signed) {
+        if(pos + size > end) {
+            pos = end;
+            return;
+        }
+        uint64_t raw = 0;
+        memcpy(&raw, pos, size);
+        pos += size;
+        if(is_signed && size < 8 && (raw & (1ull << (size * 8 - 1)))) {
+            raw |= ~0ull << (size * 8);
+        }
+        value = raw;
+    };
+
+    switch(encoding & 0x0f) {
+        case 0x00: read_fixed(8, false); break;
+        case 0x01: value = read_uleb(pos, end); break;
+        case 0x02: read_fixed(2, false); break;
+        case 0x03: read_fixed(4, false); break;
+        case 0x04: read_fixed(8, false); break;
+        case 0x09: value = read_sleb(pos, end); break;
+        case 0x0a: read_fixed(2, true); break;
+        case 0x0b: read_fixed(4, true); break;
+        case 0x0c: read_fixed(8, true); break;
+        default: break;
+    }
+
+    // Only PC-relative pointers are used by x86-64 toolchains, other bases are not resolved
+    if(relative_allowed && (encoding & 0x70) == 0x10) {
+        value += field_addr;
+    }
+
+    return value;
+
+}
+
+void cfi_unwinder::build(const elf::elf& ef) {
+
+    m_elf = ef;
+    m_read = false;
+    m_cies.clear();
+    m_fdes.clear();
+    m_rows.clear();
+
+}
+
+void cfi_unwinder::read_sections() {
+
+    m_read = true;
+
+    auto& eh_frame = m_elf.get_section(".eh_frame");
+    if(eh_frame.valid() && eh_frame.data() != nullptr) {
+        read_section(static_cast<const uint8_t*>(eh_frame.data()), eh_frame.size(), eh_frame.get_hdr().addr, true);
+    }
+
+    auto& debug_frame = m_elf.get_section(".debug_frame");
+    if(debug_frame.valid() && debug_frame.data() != nullptr) {
+        read_section(static_cast<const uint8_t*>(debug_frame.data()), debug_frame.size(), 0, false);
+    }
+
+    // .eh_frame entries were added first, so they win when both sections describe a PC
+    stable_sort(m_fdes.begin(), m_fdes.end(), [](const fde& a, const fde& b) { return a.pc_begin < b.pc_begin; });
+
+}
+
+bool cfi_unwinder::read_cie(const uint8_t* pos, const uint8_t* end, bool is_eh, cie* out) {
+
+    auto version = *pos++;
+    string augmentation;
+    while(pos < end && *pos != 0) {
+        augmentation += static_cast<char>(*pos++);
+    }
+    pos++;
+
+    if(version >= 4) {
+        // Address size and segment selector size
+        pos += 2;
+    }
+
+    out->code_align = read_uleb(pos, end);
+    out->data_align = read_sleb(pos, end);
+    out->return_register = (version == 1) ? *pos++ : read_uleb(pos, end);
+    out->pointer_encoding = is_eh ? 0x00 : 0x04;
+    out->is_eh = is_eh;
+
+    if(!augmentation.empty() && augmentation[0] == 'z') {
+        auto length = read_uleb(pos, end);
+        auto data_end = pos + length;
+
+        for(size_t i = 1; i < augmentation.size() && pos < data_end; i++) {
+            switch(augmentation[i]) {
+                case 'R':
+                    out->pointer_encoding = *pos++;
+                    break;
+                case 'P':
+                {
+                    auto encoding = *pos++;
+                    read_pointer(pos, data_end, encoding, true);
+                    break;
+                }
+                case 'L':
+                    pos++;
+                    break;
+                case 'S':
+                    break;
+                default:
+                    return false;
+            }
+        }
+        pos = data_end;
+    } else if(!augmentation.empty()) {
+        // Unknown augmentations without 'z' can't be skipped
+        return false;
+    }
+
+    out->instructions = pos;
+    out->instructions_end = end;
+
+    return pos <= end;
+
+}
+
+void cfi_unwinder::read_section(const uint8_t* data, size_t size, uint64_t base_addr, bool is_eh) {
+
+    m_section_data = data;
+    m_section_addr = base_addr;
+
+    auto section_end = data + size;
+    unordered_map<const uint8_t*, size_t> cie_by_position;
+
+    for(auto pos = data; pos + 4 <= section_end;) {
+        auto record = pos;
+
+        uint64_t length = 0;
+        memcpy(&length, pos, 4);
+        pos += 4;
+        unsigned offset_size = 4;
+        if(length == 0xffffffff) {
+            memcpy(&length, pos, 8);
+            pos += 8;
+            offset_size = 8;
+        }
+
+        // Zero terminator of .eh_frame
+        if(length == 0) {
+            if(is_eh) {
+                break;
+            }
+            continue;
+        }
+
+        auto record_end = pos + length;
+        if(record_end > section_end) {
+            break;
+        }
+
+        auto id_position = pos;
+        uint64_t id = 0;
+        memcpy(&id, pos, offset_size);
+        pos += offset_size;
+
+        bool is_cie = is_eh ? (id == 0) : (id == (offset_size == 4 ? 0xffffffffull : ~0ull));
+
+        if(is_cie) {
+            cie c;
+            if(read_cie(pos, record_end, is_eh, &c)) {
+                cie_by_position[record] = m_cies.size();
+                m_cies.push_back(c);
+            }
+        } else {
+            // The CIE pointer is relative to the field in .eh_frame and a section offset in .debug_frame
+            auto cie_record = is_eh ? (id_position - id) : (data + id);
+
+            auto iter = cie_by_position.find(cie_record);
+            if(iter == cie_by_position.end()) {
+                cie c;
+                if(cie_record < data || cie_record + 4 > section_end) {
+                    pos = record_end;
+                    continue;
+                }
+
+                // CIE placed after its first FDE
+                uint64_t cie_length = 0;
+                memcpy(&cie_length, cie_record, 4);
+                size_t length_size = 4;
+                if(cie_length == 0xffffffff) {
+                    memcpy(&cie_length, cie_record + 4, 8);
+                    length_size = 12;
+                }
+                auto cie_start = cie_record + length_size + offset_size;
+                auto cie_end = cie_record + length_size + cie_length;
+
+                if(cie_end > section_end || !read_cie(cie_start, cie_end, is_eh, &c)) {
+                    pos = record_end;
+                    continue;
+                }
+                iter = cie_by_position.emplace(cie_record, m_cies.size()).first;
+                m_cies.push_back(c);
+            }
+
+            auto& c = m_cies[iter->second];
+            fde f;
+            f.cie = iter->second;
+            f.pc_begin = read_pointer(pos, record_end, c.pointer_encoding, true);
+            f.pc_end = f.pc_begin + read_pointer(pos, record_end, c.pointer_encoding & 0x0f, false);
+
+            if(is_eh) {
+                // Augmentation data of the FDE ('z')
+                auto length = read_uleb(pos, record_end);
+                pos += length;
+            }
+
+            f.instructions = pos;
+            f.instructions_end = record_end;
+
+            if(f.pc_begin < f.pc_end && pos <= record_end) {
+                m_fdes.push_back(f);
+            }
+        }
+
+        pos = record_end;
+    }
+
+}
+
+// Runs CFA instructions until the location passes target, updating current
+bool cfi_unwinder::run_program(const uint8_t* pos, const uint8_t* end, const cie& c, uint64_t target, uint64_t* loc,
+                               row& current, const row& initial) {
+
+    vector<row> stack;
+
+    auto set_rule = [&current](uint64_t reg, rule::kind_type kind, int64_t value) {
+        if(reg < unwind_registers::count) {
+            current.rules[reg] = rule{kind, value};
+        }
+    };
+
+    while(pos < end) {
+        auto op = *pos++;
+        unsigned operand = op & 0x3f;
+
+        switch(op >> 6) {
+            case 0x1:
+                // DW_CFA_advance_loc
+                *loc += operand * c.code_align;
+                if(*loc > target) {
+                    return true;
+                }
+                continue;
+            case 0x2:
+                // DW_CFA_offset
+                set_rule(operand, rule::offset, static_cast<int64_t>(read_uleb(pos, end)) * c.data_align);
+                continue;
+            case 0x3:
+                // DW_CFA_restore
+                if(operand < unwind_registers::count) {
+                    current.rules[operand] = initial.rules[operand];
+                }
+                continue;
+            default:
+                break;
+        }
+
+        switch(op) {
+            case 0x00:
+                // DW_CFA_nop
+                break;
+            case 0x01:
+                // DW_CFA_set_loc, compilers don't emit it with PC-relative encodings
+                *loc = read_pointer(pos, end, c.pointer_encoding, false);
+                if(*loc > target) {
+                    return true;
+                }
+                break;
+            case 0x02:
+            case 0x03:
+            case 0x04:
+            {
+                // DW_CFA_advance_loc1/2/4
+                size_t size = (op == 0x02) ? 1 : (op == 0x03) ? 2 : 4;
+                if(pos + size > end) {
+                    return false;
+                }
+                uint64_t delta = 0;
+                memcpy(&delta, pos, size);
+                pos += size;
+                *loc += delta * c.code_align;
+                if(*loc > target) {
+                    return true;
+                }
+                break;
+            }
+            case 0x05:
+            {
+                // DW_CFA_offset_extended
+                auto reg = read_uleb(pos, end);
+                set_rule(reg, rule::offset, static_cast<int64_t>(read_uleb(pos, end)) * c.data_align);
+                break;
+            }
+            case 0x06:
+            {
+                // DW_CFA_restore_extended
+                auto reg = read_uleb(pos, end);
+                if(reg < unwind_registers::count) {
+                    current.rules[reg] = initial.rules[reg];
+                }
+                break;
+            }
+            case 0x07:
+                // DW_CFA_undefined
+                set_rule(read_uleb(pos, end), rule::undefined, 0);
+                break;
+            case 0x08:
+                // DW_CFA_same_value
+                set_rule(read_uleb(pos, end), rule::same_value, 0);
+                break;
+            case 0x09:
+            {
+                // DW_CFA_register
+                auto reg = read_uleb(pos, end);
+                set_rule(reg, rule::reg, read_uleb(pos, end));
+                break;
+            }
+            case 0x0a:
+                // DW_CFA_remember_state
+                stack.push_back(current);
+                break;
+            case 0x0b:
+                // DW_CFA_restore_state
+                if(stack.empty()) {
+                    return false;
+                }
+                current = stack.back();
+                stack.pop_back();
+                break;
+            case 0x0c:
+                // DW_CFA_def_cfa
+                current.cfa_register = read_uleb(pos, end);
+                current.cfa_offset = read_uleb(pos, end);
+                current.cfa_supported = true;
+                break;
+            case 0x0d:
+                // DW_CFA_def_cfa_register
+                current.cfa_register = read_uleb(pos, end);
+                break;
+            case 0x0e:
+                // DW_CFA_def_cfa_offset
+                current.cfa_offset = read_uleb(pos, end);
+                break;
+            case 0x0f:
+            {
+                // DW_CFA_def_cfa_expression, only used in PLT stubs and signal trampolines
+                auto length = read_uleb(pos, end);
+                pos += length;
+                current.cfa_supported = false;
+                break;
+            }
+            case 0x10:
+            case 0x16:
+            {
+                // DW_CFA_expression and DW_CFA_val_expression
+                auto reg = read_uleb(pos, end);
+                auto length = read_uleb(pos, end);
+                pos += length;
+                set_rule(reg, rule::unsupported, 0);
+                break;
+            }
+            case 0x11:
+            {
+                // DW_CFA_offset_extended_sf
+                auto reg = read_uleb(pos, end);
+                set_rule(reg, rule::offset, read_sleb(pos, end) * c.data_align);
+                break;
+            }
+            case 0x12:
+                // DW_CFA_def_cfa_sf
+                current.cfa_register = read_uleb(pos, end);
+                current.cfa_offset = read_sleb(pos, end) * c.data_align;
+                current.cfa_supported = true;
+                break;
+            case 0x13:
+                // DW_CFA_def_cfa_offset_sf
+                current.cfa_offset = read_sleb(pos, end) * c.data_align;
+                break;
+            case 0x14:
+            {
+                // DW_CFA_val_offset
+                auto reg = read_uleb(pos, end);
+                set_rule(reg, rule::val_offset, static_cast<int64_t>(read_uleb(pos, end)) * c.data_align);
+                break;
+            }
+            case 0x15:
+            {
+                // DW_CFA_val_offset_sf
+                auto reg = read_uleb(pos, end);
+                set_rule(reg, rule::val_offset, read_sleb(pos, end) * c.data_align);
+                break;
+            }
+            case 0x2e:
+                // DW_CFA_GNU_args_size
+                read_uleb(pos, end);
+                break;
+            case 0x2f:
+            {
+                // DW_CFA_GNU_negative_offset_extended
+                auto reg = read_uleb(pos, end);
+                set_rule(reg, rule::offset, -static_cast<int64_t>(read_uleb(pos, end)) * c.data_align);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+
+    return true;
+
+}
+
+const cfi_unwinder::row* cfi_unwinder::find_row(uint64_t pc) {
+
+    auto cached = m_rows.find(pc);
+    if(cached != m_rows.end()) {
+        return &cached->second;
+    }
+
+    auto iter = upper_bound(m_fdes.begin(), m_fdes.end(), pc, [](uint64_t value, const fde& f) { return value < f.pc_begin; });
+    if(iter == m_fdes.begin()) {
+        return nullptr;
+    }
+
+    // FDEs don't overlap, only the last one starting at or before pc can cover it
+    auto found = &*(iter - 1);
+    if(pc >= found->pc_end) {
+        return nullptr;
+    }
+
+    auto& c = m_cies[found->cie];
+
+    row initial;
+    initial.cfa_register = unwind_registers::rsp;
+    initial.cfa_offset = 0;
+    initial.cfa_supported = true;
+    initial.rules.fill(rule{rule::same_value, 0});
+
+    // The initial instructions of the CIE apply at every PC, the FDE program then runs up to pc
+    uint64_t loc = found->pc_begin;
+    if(!run_program(c.instructions, c.instructions_end, c, ~0ull, &loc, initial, initial)) {
+        return nullptr;
+    }
+
+    row current = initial;
+    loc = found->pc_begin;
+    if(!run_program(found->instructions, found->instructions_end, c, pc, &loc, current, initial)) {
+        return nullptr;
+    }
+
+    // The return address column of the CIE is where the caller's PC comes from
+    if(c.return_register < unwind_registers::count && c.return_register != unwind_registers::return_address) {
+        current.rules[unwind_registers::return_address] = current.rules[c.return_register];
+    }
+
+    return &m_rows.emplace(pc, current).first->second;
+
+}
+
+bool cfi_unwinder::step(unwind_registers& regs, memory_cache& memory, uint64_t load_address, bool innermost) {
+
+    if(!regs.known[unwind_registers::return_address]) {
+        return false;
+    }
+    if(!m_read) {
+        read_sections();
+    }
+
+    auto pc = regs.values[unwind_registers::return_address] - load_address;
+    auto r = find_row(innermost ? pc : pc - 1);
+
+    if(r == nullptr || !r->cfa_supported || r->cfa_register >= unwind_registers::count || !regs.known[r->cfa_register]) {
+        return false;
+    }
+
+    // Without a saved return address the caller would be the same frame again
+    if(r->rules[unwind_registers::return_address].kind == rule::same_value) {
+        return false;
+    }
+
+    auto cfa = regs.values[r->cfa_register] + r->cfa_offset;
+
+    unwind_registers caller;
+    for(unsigned reg = 0; reg < unwind_registers::count; reg++) {
+        auto& rl = r->rules[reg];
+        switch(rl.kind) {
+            case rule::same_value:
+                caller.values[reg] = regs.values[reg];
+                caller.known[reg] = regs.known[reg];
+                break;
+            case rule::offset:
+                caller.known[reg] = memory.read(cfa + rl.value, &caller.values[reg], sizeof(uint64_t));
+                break;
+            case rule::val_offset:
+                caller.values[reg] = cfa + rl.value;
+                caller.known[reg] = true;
+                break;
+            case rule::reg:
+                if(rl.value >= 0 && rl.value < static_cast<int64_t>(unwind_registers::count)) {
+                    caller.values[reg] = regs.values[rl.value];
+                    caller.known[reg] = regs.known[rl.value];
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    // The stack pointer of the caller is the CFA by definition
+    caller.values[unwind_registers::rsp] = cfa;
+    caller.known[unwind_registers::rsp] = true;
+
+    if(!caller.known[unwind_registers::return_address]) {
+        return false;
+    }
+
+    regs = caller;
+    return true;
+
+}
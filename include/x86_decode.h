@@ -0,0 +1,363 @@
+#include <bits/stdc++.h>
+
+using namespace std;
+
+// How an instruction can transfer control, as far as range stepping is concerned
+enum class insn_kind {
+    other,
+    jump,
+    cond_jump,
+    call,
+    indirect_jump,
+    indirect_call,
+    ret
+};
+
+struct x86_insn {
+    unsigned length;
+    insn_kind kind;
+    // Destination of direct jumps and calls
+    uint64_t target;
+};
+
+// Minimal x86-64 length decoder: it walks prefixes, REX/VEX/EVEX, opcode, ModRM/SIB, displacement and
+// immediate to find instruction boundaries and branch targets. Unknown encodings make it return false.
+class x86_decoder {
+
+    public:
+        static bool decode(const uint8_t* code, size_t size, uint64_t addr, x86_insn* out);
+
+    private:
+        static bool one_byte_has_modrm(uint8_t op);
+        static bool two_byte_has_modrm(uint8_t op);
+        static unsigned two_byte_imm_size(uint8_t op);
+
+};
+
+bool x86_decoder::one_byte_has_modrm(uint8_t op) {
+
+    if(op < 0x40) {
+        return (op & 0x07) < 0x04;
+    }
+
+    switch(op) {
+        case 0x63: case 0x69: case 0x6b:
+        case 0x80: case 0x81: case 0x83: case 0x84: case 0x85: case 0x86: case 0x87:
+        case 0x88: case 0x89: case 0x8a: case 0x8b: case 0x8c: case 0x8d: case 0x8e: case 0x8f:
+        case 0xc0: case 0xc1: case 0xc6: case 0xc7:
+        case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+        case 0xd8: case 0xd9: case 0xda: case 0xdb: case 0xdc: case 0xdd: case 0xde: case 0xdf:
+        case 0xf6: case 0xf7: case 0xfe: case 0xff:
+            return true;
+        default:
+            return false;
+    }
+
+}
+
+bool x86_decoder::two_byte_has_modrm(uint8_t op) {
+
+    switch(op) {
+        case 0x05: case 0x06: case 0x07: case 0x08: case 0x09: case 0x0b: case 0x0e:
+        case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: case 0x35: case 0x37:
+        case 0x77:
+        case 0xa0: case 0xa1: case 0xa2: case 0xa8: case 0xa9: case 0xaa:
+            return false;
+        default:
+            // Jcc rel32 and bswap encode their operands without ModRM
+            return !(op >= 0x80 && op <= 0x8f) && !(op >= 0xc8 && op <= 0xcf);
+    }
+
+}
+
+unsigned x86_decoder::two_byte_imm_size(uint8_t op) {
+
+    switch(op) {
+        case 0x70: case 0x71: case 0x72: case 0x73:
+        case 0xa4: case 0xac: case 0xba:
+        case 0xc2: case 0xc4: case 0xc5: case 0xc6:
+            return 1;
+        default:
+            return 0;
+    }
+
+}
+
+bool x86_decoder::decode(const uint8_t* code, size_t size, uint64_t addr, x86_insn* out) {
+
+    size_t pos = 0;
+    bool operand_size_16 = false;
+    bool address_size_32 = false;
+    bool rex_w = false;
+
+    auto next = [&](uint8_t* byte) {
+        if(pos >= size || pos >= 15) {
+            return false;
+        }
+        *byte = code[pos++];
+        return true;
+    };
+
+    uint8_t op;
+
+    // Legacy prefixes
+    while(true) {
+        if(!next(&op)) {
+            return false;
+        }
+        if(op == 0x66) {
+            operand_size_16 = true;
+        } else if(op == 0x67) {
+            address_size_32 = true;
+        } else if(op != 0xf0 && op != 0xf2 && op != 0xf3 && op != 0x2e && op != 0x36 &&
+                  op != 0x3e && op != 0x26 && op != 0x64 && op != 0x65) {
+            break;
+        }
+    }
+
+    // REX prefix, it has to be the last prefix before the opcode
+    if((op & 0xf0) == 0x40) {
+        rex_w = op & 0x08;
+        if(!next(&op)) {
+            return false;
+        }
+    }
+
+    // Opcode map: 1 -> one byte, 2 -> 0F, 3 -> 0F 38, 4 -> 0F 3A
+    unsigned map = 1;
+    bool is_vex = false;
+
+    if(op == 0xc4 || op == 0xc5 || op == 0x62) {
+        // VEX (C4/C5) and EVEX (62) prefixes are always valid in 64-bit mode
+        uint8_t p0, p1, p2;
+        if(op == 0xc5) {
+            if(!next(&p0)) {
+                return false;
+            }
+            map = 2;
+        } else if(op == 0xc4) {
+            if(!next(&p0) || !next(&p1)) {
+                return false;
+            }
+            map = (p0 & 0x1f) + 1;
+            rex_w = p1 & 0x80;
+        } else {
+            if(!next(&p0) || !next(&p1) || !next(&p2)) {
+                return false;
+            }
+            map = (p0 & 0x07) + 1;
+            rex_w = p1 & 0x80;
+        }
+        if(map < 2 || map > 4) {
+            return false;
+        }
+        if(!next(&op)) {
+            return false;
+        }
+        is_vex = true;
+    } else if(op == 0x0f) {
+        if(!next(&op)) {
+            return false;
+        }
+        map = 2;
+        if(op == 0x38 || op == 0x3a) {
+            map = (op == 0x38) ? 3 : 4;
+            if(!next(&op)) {
+                return false;
+            }
+        }
+    }
+
+    bool has_modrm = false;
+    unsigned imm_size = 0;
+    unsigned immz = operand_size_16 ? 2 : 4;
+    x86_insn insn{0, insn_kind::other, 0};
+
+    switch(map) {
+        case 1:
+        {
+            has_modrm = one_byte_has_modrm(op);
+
+            if(op < 0x40) {
+                // Removed BCD/segment opcodes of the ALU rows
+                if((op & 0x07) == 0x06 || (op & 0x07) == 0x07) {
+                    return false;
+                }
+                if((op & 0x07) == 0x04) {
+                    imm_size = 1;
+                } else if((op & 0x07) == 0x05) {
+                    imm_size = immz;
+                }
+            } else if(op >= 0x70 && op <= 0x7f) {
+                insn.kind = insn_kind::cond_jump;
+                imm_size = 1;
+            } else if(op >= 0xb0 && op <= 0xb7) {
+                imm_size = 1;
+            } else if(op >= 0xb8 && op <= 0xbf) {
+                imm_size = rex_w ? 8 : immz;
+            } else {
+                switch(op) {
+                    case 0x60: case 0x61: case 0x82: case 0x9a: case 0xce: case 0xd4: case 0xd5: case 0xd6: case 0xea:
+                        return false;
+                    case 0x68: case 0x69: case 0x81: case 0xa9: case 0xc7:
+                        imm_size = immz;
+                        break;
+                    case 0x6a: case 0x6b: case 0x80: case 0x83: case 0xa8: case 0xc0: case 0xc1: case 0xc6:
+                    case 0xcd: case 0xe4: case 0xe5: case 0xe6: case 0xe7:
+                        imm_size = 1;
+                        break;
+                    case 0xa0: case 0xa1: case 0xa2: case 0xa3:
+                        imm_size = address_size_32 ? 4 : 8;
+                        break;
+                    case 0xc2:
+                        insn.kind = insn_kind::ret;
+                        imm_size = 2;
+                        break;
+                    case 0xca:
+                        insn.kind = insn_kind::ret;
+                        imm_size = 2;
+                        break;
+                    case 0xc3: case 0xcb: case 0xcf:
+                        insn.kind = insn_kind::ret;
+                        break;
+                    case 0xc8:
+                        imm_size = 3;
+                        break;
+                    case 0xcc:
+                        // A real int3 in the code, let the caller single-step it
+                        return false;
+                    case 0xe0: case 0xe1: case 0xe2: case 0xe3:
+                        insn.kind = insn_kind::cond_jump;
+                        imm_size = 1;
+                        break;
+                    case 0xe8:
+                        insn.kind = insn_kind::call;
+                        imm_size = 4;
+                        break;
+                    case 0xe9:
+                        insn.kind = insn_kind::jump;
+                        imm_size = 4;
+                        break;
+                    case 0xeb:
+                        insn.kind = insn_kind::jump;
+                        imm_size = 1;
+                        break;
+                    default:
+                        break;
+                }
+            }
+            break;
+        }
+        case 2:
+        {
+            if(is_vex) {
+                // vzeroupper/vzeroall are the only VEX instructions without ModRM
+                has_modrm = (op != 0x77);
+            } else {
+                switch(op) {
+                    case 0x04: case 0x0a: case 0x0c: case 0x0f: case 0x24: case 0x25: case 0x26: case 0x27:
+                    case 0x36: case 0x39: case 0x3b: case 0x3c: case 0x3d: case 0x3e: case 0x3f:
+                        return false;
+                    default:
+                        break;
+                }
+                has_modrm = two_byte_has_modrm(op);
+            }
+            imm_size = two_byte_imm_size(op);
+
+            if(!is_vex && op >= 0x80 && op <= 0x8f) {
+                insn.kind = insn_kind::cond_jump;
+                imm_size = 4;
+            }
+            break;
+        }
+        case 3:
+            has_modrm = true;
+            break;
+        case 4:
+            has_modrm = true;
+            imm_size = 1;
+            break;
+    }
+
+    if(has_modrm) {
+        uint8_t modrm;
+        if(!next(&modrm)) {
+            return false;
+        }
+
+        unsigned mod = modrm >> 6;
+        unsigned reg = (modrm >> 3) & 0x07;
+        unsigned rm = modrm & 0x07;
+        unsigned disp_size = 0;
+
+        if(mod != 3) {
+            if(rm == 4) {
+                uint8_t sib;
+                if(!next(&sib)) {
+                    return false;
+                }
+                if(mod == 0 && (sib & 0x07) == 5) {
+                    disp_size = 4;
+                }
+            }
+            if(mod == 0 && rm == 5) {
+                // RIP relative
+                disp_size = 4;
+            } else if(mod == 1) {
+                disp_size = 1;
+            } else if(mod == 2) {
+                disp_size = 4;
+            }
+        }
+        pos += disp_size;
+
+        if(map == 1) {
+            // Group 3 test has an immediate, the other members don't
+            if(op == 0xf6 && reg < 2) {
+                imm_size = 1;
+            } else if(op == 0xf7 && reg < 2) {
+                imm_size = immz;
+            } else if(op == 0xff) {
+                if(reg == 2 || reg == 3) {
+                    insn.kind = insn_kind::indirect_call;
+                } else if(reg == 4 || reg == 5) {
+                    insn.kind = insn_kind::indirect_jump;
+                }
+            } else if(op == 0x8f && reg != 0) {
+                // AMD XOP prefix
+                return false;
+            } else if(op == 0xc7 && modrm == 0xf8) {
+                // xbegin can jump to its abort handler
+                return false;
+            }
+        }
+    }
+
+    // The immediate of a relative branch is its displacement
+    int64_t displacement = 0;
+    if(insn.kind == insn_kind::jump || insn.kind == insn_kind::cond_jump || insn.kind == insn_kind::call) {
+        if(pos + imm_size > size) {
+            return false;
+        }
+        if(imm_size == 1) {
+            displacement = static_cast<int8_t>(code[pos]);
+        } else {
+            int32_t rel32;
+            memcpy(&rel32, code + pos, sizeof(rel32));
+            displacement = rel32;
+        }
+    }
+    pos += imm_size;
+
+    if(pos > size || pos > 15) {
+        return false;
+    }
+
+    insn.length = pos;
+    insn.target = addr + pos + displacement;
+    *out = insn;
+
+    return true;
+
+}
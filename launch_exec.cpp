@@ -3,6 +3,12 @@
 #include <sys/ptrace.h>
 #include <sys/user.h>
 #include <sys/personality.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <dirent.h>
+#include <link.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <bits/stdc++.h>
@@ -10,8 +16,27 @@
 #include "linenoise/linenoise.hpp"
 #include "include/helper.h"
 #include "include/breakpoint.h"
+#include "include/hw_breakpoint.h"
 #include "include/registers.h"
+#include "include/expression.h"
+#include "include/trace_log.h"
+#include "include/histogram.h"
+#include "include/threads.h"
+#include "include/memory.h"
+#include "include/syscalls.h"
+#include "include/x86_decode.h"
+#include "include/mapped_array.h"
 #include "include/symbol.h"
+#include "include/cu_index.h"
+#include "include/function_index.h"
+#include "include/line_index.h"
+#include "include/name_index.h"
+#include "include/dwarf_indexer.h"
+#include "include/index_cache.h"
+#include "include/unwinder.h"
+#include "include/modules.h"
+#include "include/profiler.h"
+#include "include/event_loop.h"
 #include "dwarf/dwarf++.hh"
 #include "elf/elf++.hh"
 
@@ -20,32 +45,128 @@ using namespace std;
 class ptrace_expr_context : public dwarf::expr_context {
 
     public:
-        ptrace_expr_context (pid_t pid, uint64_t load_addr) : m_pid{pid}, m_load_addr{load_addr} {}
+        ptrace_expr_context (pid_t pid, register_cache& regs, memory_cache& memory, uint64_t load_addr) : m_pid{pid}, m_regs{regs}, m_memory{memory}, m_load_addr{load_addr} {}
 
         dwarf::taddr reg(unsigned regnum) override {
-            return get_register_value_from_dwarf_register(m_pid, regnum);
+            return get_register_value_from_dwarf_register(m_regs, regnum);
         }
 
         dwarf::taddr pc() {
-            struct user_regs_struct registers;
-            ptrace(PTRACE_GETREGS, m_pid, nullptr, &registers);
-            return registers.rip - m_load_addr;
+            return get_register_value_from_type(m_regs, register_type::rip) - m_load_addr;
         }
 
         dwarf::taddr deref_size(dwarf::taddr address, unsigned size) override {
-            return ptrace(PTRACE_PEEKDATA, m_pid, address + m_load_addr, nullptr);
+            dwarf::taddr value = 0;
+            m_memory.read(address + m_load_addr, &value, min<unsigned>(size, sizeof(value)));
+            return value;
         }
 
     private:
         pid_t m_pid;
+        register_cache& m_regs;
+        memory_cache& m_memory;
         uint64_t m_load_addr;
 
 };
 
+// Variable of a breakpoint condition, its DWARF location is evaluated on every hit
+struct located_variable {
+    dwarf::expr location;
+    unsigned size;
+    bool is_signed;
+    // Global locations are link addresses
+    bool global;
+};
+
+struct breakpoint_condition {
+    expression condition;
+    vector<located_variable> variables;
+};
+
+struct traced_function {
+    string name;
+    latency_histogram latencies;
+    // Calls left by a longjmp or an exception, or whose return address had another breakpoint
+    uint64_t untimed = 0;
+};
+
+// Call waiting for its return breakpoint, the stack pointer tells recursive calls apart
+struct pending_call {
+    size_t function;
+    uint64_t return_address;
+    uint64_t stack_pointer;
+    chrono::steady_clock::time_point start;
+};
+
+struct tracepoint {
+    uint32_t id;
+    string format;
+    vector<expression> arguments;
+    vector<located_variable> variables;
+};
+
+class condition_context : public expression::context {
+
+    public:
+        condition_context (pid_t pid, register_cache& regs, memory_cache& memory, uint64_t load_addr, const vector<located_variable>& variables)
+            : m_pid{pid}, m_regs{regs}, m_memory{memory}, m_load_addr{load_addr}, m_variables{variables} {}
+
+        uint64_t get_register(register_type type) override {
+            return m_regs.get(type);
+        }
+
+        uint64_t read_memory(uint64_t addr) override {
+            return m_memory.read_word(addr);
+        }
+
+        int64_t get_variable(size_t index) override {
+
+            auto& variable = m_variables[index];
+            ptrace_expr_context context {m_pid, m_regs, m_memory, m_load_addr};
+            auto result = variable.location.evaluate(&context);
+
+            uint64_t value = 0;
+            switch(result.location_type) {
+                case dwarf::expr_result::type::address:
+                    if(!m_memory.read(result.value + (variable.global ? m_load_addr : 0), &value, variable.size)) {
+                        throw runtime_error {"Cannot read variable!!!"};
+                    }
+                    break;
+                case dwarf::expr_result::type::reg:
+                    value = get_register_value_from_dwarf_register(m_regs, result.value);
+                    break;
+                case dwarf::expr_result::type::literal:
+                    value = result.value;
+                    break;
+                default:
+                    throw runtime_error {"Unhandled variable location!!!"};
+            }
+
+            // Sign extension of smaller signed types
+            auto shift = 64 - 8 * variable.size;
+            if(variable.is_signed && shift != 0) {
+                return static_cast<int64_t>(value << shift) >> shift;
+            }
+            return value;
+
+        }
+
+    private:
+        pid_t m_pid;
+        register_cache& m_regs;
+        memory_cache& m_memory;
+        uint64_t m_load_addr;
+        const vector<located_variable>& m_variables;
+
+};
+
 class debugger {
 
     public:
-        debugger(string prog_name, pid_t pid) : m_prog_name{move(prog_name)}, m_pid{pid} {
+        debugger(string prog_name, pid_t pid, bool lazy_index = false, unsigned index_threads = 0) : m_prog_name{move(prog_name)}, m_pid{pid}, m_memory{pid} {
+
+            m_threads.emplace(pid, tracee_thread{pid});
+            switch_thread(pid);
 
             auto file = open(m_prog_name.c_str(), O_RDONLY);
 
@@ -57,55 +178,260 @@ class debugger {
                 dwarf::elf::create_loader(m_elf)
             };
 
+            // Index all function ranges, line tables and symbols once so that lookups don't rescan the DWARF info.
+            // The indexes are saved on disk, so that the next run on the same build only has to map them.
+            auto index_start = chrono::steady_clock::now();
+
+            // Compile units are indexed by one thread per core unless told otherwise, the debugger thread included
+            m_index_threads = index_threads ? index_threads : max(1u, thread::hardware_concurrency());
+
+            m_index_from_cache = m_index_cache.load(m_elf, m_dwarf, m_func_index, m_line_index, m_symbols, m_names, m_cu_index);
+
+            // PC -> compile unit table, read from .debug_aranges when the binary has it
+            if(!m_index_from_cache) {
+                m_cu_index.build(m_elf, m_dwarf);
+            }
+
+            // Names come from .debug_pubnames when the compiler wrote it, else from the DIEs of every unit
+            bool pubnames = !m_index_from_cache && m_names.read_pubnames(m_elf, m_dwarf);
+
+            if(!m_index_from_cache && lazy_index) {
+                // The prompt comes up right away, the debugger thread only indexes what its lookups need
+                m_symbols.build(m_elf);
+                m_indexer = make_unique<dwarf_indexer>(m_dwarf, !pubnames);
+                m_indexer->start(max(1u, m_index_threads - 1));
+            } else if(!m_index_from_cache) {
+                m_symbols.build(m_elf);
+
+                dwarf_indexer indexer{m_dwarf, !pubnames};
+                indexer.start(m_index_threads - 1);
+                indexer.wait();
+                indexer.merge(m_func_index, m_line_index, m_names);
+                m_index_steals = indexer.get_steals();
+
+                // Writing the index is left to the event loop, it runs while the tracee does
+                m_events.add_idle_task([this]() {
+                    m_index_cache.save(m_elf, m_func_index, m_line_index, m_symbols, m_names, m_cu_index);
+                    return false;
+                });
+            }
+
+            m_index_time = chrono::steady_clock::now() - index_start;
+
+            // Call frame information is read when the first frame is unwound
+            m_unwinder.build(m_elf);
+
         }
 
         void run();
+        bool attach();
+        void detach();
         void runCommand(const string& line);
-        void continue_execution();
+        void continue_execution(bool all_threads = true);
+        void resume(__ptrace_request request, int signal = 0);
+        void resume_thread(tracee_thread& thread, __ptrace_request request);
+        void resume_other_threads();
+        void stop_other_threads();
+        void switch_thread(pid_t tid);
+        bool handle_thread_event(pid_t tid, int wait_status);
+        bool report_pending_event();
+        void print_threads();
         void addBreakpoint(intptr_t addr);
+        void set_breakpoint(const string& location);
+        unordered_set<intptr_t> get_breakpoint_addresses();
+        void set_tracepoint(const string& location, const string& format, const vector<string>& arguments);
+        bool record_tracepoint(intptr_t addr);
+        void print_tracepoints();
+        void print_trace(size_t count);
+        void set_calltrace(const string& location);
+        bool calltrace_entry(intptr_t addr);
+        bool calltrace_return(intptr_t addr);
+        void print_calltrace();
+        void stop_calltrace();
+        void set_catch_syscalls(const vector<string>& names);
+        bool handle_syscall_stop(tracee_thread& thread);
+        bool is_caught_syscall(long number);
+        void report_syscall();
+        void trace_syscalls(const set<long>& syscalls, bool filtered);
+        void set_condition(const vector<intptr_t>& addrs, const unordered_set<intptr_t>& existing, const string& text);
+        ssize_t resolve_variable(intptr_t addr, const string& name, vector<located_variable>& variables);
+        bool check_condition(intptr_t addr);
+        bool run_breakpoint_action(intptr_t addr);
+        void add_breakpoints(const vector<intptr_t>& addrs);
+        void remove_breakpoints(const vector<intptr_t>& addrs);
+        void patch_breakpoints(const vector<intptr_t>& addrs, bool enable);
         void dump_registers();
+        void dump_memory(uint64_t addr, size_t len);
         uint64_t get_program_counter();
         void set_program_counter(uint64_t pc);
         void step_over_breakpoint();
         dwarf::die get_func_using_pc(uint64_t pc);
-        dwarf::line_table::iterator get_line_entry_using_pc(uint64_t pc);
+        line_index::iterator get_line_entry_using_pc(uint64_t pc);
+        const function_index* get_function_index(uint64_t pc);
+        const line_index* get_line_index(uint64_t pc);
+        void finish_indexing(bool wait);
         void initialize_load_address();
+        void init_shared_libraries();
+        bool find_r_debug();
+        bool update_shared_libraries();
+        bool find_mapping(const string& path, uint64_t* start);
+        string read_string(uint64_t addr);
+        void print_modules();
         uint64_t get_offset_load_address(uint64_t addr);
         void print_source(string file_name, unsigned line, unsigned context_size);
         siginfo_t get_signal_info();
-        void wait_for_signal();
+        void setup_event_loop();
+        void handle_signalfd();
+        void handle_stdin();
+        void interrupt();
+        bool wait_for_stop(bool any_thread);
+        void wait_for_signal(bool any_thread = false);
+        bool wait_for_breakpoint();
+        void handle_signal(siginfo_t);
         void handle_bptrap(siginfo_t);
+        void report_stop(siginfo_t);
+        void report_breakpoint();
         void single_step_instruction();
         void single_step_instruction_with_bp_check();
         uint64_t read_memory(uint64_t addr);
         void write_memory(uint64_t addr, uint64_t value);
         void remove_breakpoint(intptr_t addr);
+        void add_hw_breakpoint(uint64_t addr, hw_break_type type, unsigned len);
         uint64_t get_offset_program_counter();
         uint64_t get_offset_dwarf_address(uint64_t addr);
         void step_out();
         void step_in();
+        bool step_through_range(dwarf::taddr low, dwarf::taddr high);
         void step_over();
         void set_bp_at_func(string name);
         void set_bp_at_source_line(string file_name, unsigned line);
         vector<symbol> lookup_symbol(string name);
+        bool get_function_at(uint64_t pc, string* name, uint64_t* start);
+        bool find_function(uint64_t addr, string* name, uint64_t* start);
+        string symbolize(uint64_t addr);
+        unwind_registers get_unwind_registers();
+        bool unwind_frame(unwind_registers& regs, bool innermost);
+        uint64_t get_return_address();
         void print_backtrace();
+        vector<uint64_t> sample_stack(uint64_t stack_end);
+        void profile(unsigned frequency, const string& output_path);
+        void coverage(const string& output_path);
         void read_variables();
 
     private:
         string m_prog_name;
         pid_t m_pid;
+        map<pid_t, tracee_thread> m_threads;
+        // Current thread, the one the commands apply to
+        pid_t m_tid;
+        register_cache* m_registers;
+        bool m_non_stop = false;
+        // Attached to a running process rather than started by the debugger
+        bool m_attached = false;
+        memory_cache m_memory;
         unordered_map<intptr_t, breakpoint> addr_to_bp;
+        // Breakpoints handled by the debugger itself, the program is resumed when the action returns true
+        unordered_map<intptr_t, function<bool()>> m_bp_actions;
+        unordered_map<intptr_t, breakpoint_condition> m_conditions;
+        // Breakpoints set by the current command
+        vector<intptr_t> m_new_breakpoints;
+        // Breakpoint hits the program was resumed from without stopping at the prompt
+        uint64_t m_auto_resumes = 0;
+        chrono::nanoseconds m_auto_resume_time{0};
+        double m_auto_resume_rate = 0;
+        unordered_map<intptr_t, tracepoint> m_tracepoints;
+        uint32_t m_next_tracepoint_id = 1;
+        trace_log m_trace;
+        chrono::steady_clock::time_point m_trace_start;
+        vector<traced_function> m_traced_functions;
+        // Entry breakpoint -> traced function
+        unordered_map<intptr_t, size_t> m_calltrace_entries;
+        // Return breakpoints stay for the next calls, patching them for every call would cost two more syscalls
+        unordered_set<intptr_t> m_calltrace_returns;
+        // Return breakpoints the user also set with break, they stop the program and stay when calltrace stops
+        unordered_set<intptr_t> m_calltrace_user_returns;
+        unordered_map<pid_t, vector<pending_call>> m_pending_calls;
+        uint64_t m_calltrace_events = 0;
+        chrono::nanoseconds m_calltrace_overhead{0};
+        bool m_calltrace_reported = false;
+        // Resumes with PTRACE_SYSCALL to stop at every system call, the caught ones (all when empty) are reported
+        bool m_catch_syscalls = false;
+        set<long> m_caught_syscalls;
+        // --syscalls: caught system calls are printed instead of stopping the program
+        bool m_syscall_log = false;
+        syscall_stats m_syscall_stats;
+        hw_debug_registers m_hw_breakpoints;
         dwarf::dwarf m_dwarf;
         elf::elf m_elf;
-        uint64_t m_load_address;
+        uint64_t m_load_address = 0;
+        cu_index m_cu_index;
+        function_index m_func_index;
+        line_index m_line_index;
+        name_index m_names;
+        symbol_table m_symbols;
+        index_cache m_index_cache;
+        // Background indexing, null once the global indexes are complete
+        unique_ptr<dwarf_indexer> m_indexer;
+        chrono::nanoseconds m_background_index_time{0};
+        unsigned m_index_threads = 1;
+        uint64_t m_index_steals = 0;
+        cfi_unwinder m_unwinder;
+        module_map m_modules;
+        // Address of the r_debug structure of the dynamic linker, 0 until it is known
+        uint64_t m_r_debug = 0;
+        bool m_index_from_cache = false;
+        chrono::nanoseconds m_index_time{0};
+        uint64_t m_step_over_count = 0;
+        chrono::nanoseconds m_step_over_time{0};
+        uint64_t m_function_lookups = 0;
+        chrono::nanoseconds m_function_lookup_time{0};
+        event_loop m_events;
+        int m_signal_fd = -1;
+        int m_pid_fd = -1;
+        bool m_waiting = false;
+        bool m_interrupt_sent = false;
+        bool m_exited = false;
 
 };
 
 
 void debugger::run() {
 
-    wait_for_signal();
+    setup_event_loop();
+
+    // New threads are traced too, they report a clone event and then stop with SIGSTOP
+    if(!m_attached) {
+        wait_for_signal();
+        ptrace(PTRACE_SETOPTIONS, m_pid, nullptr, PTRACE_O_TRACECLONE | PTRACE_O_TRACESYSGOOD);
+    }
     initialize_load_address();
+    init_shared_libraries();
+
+    // Tab completion of function names for break and symbol
+    linenoise::SetCompletionCallback([this](const char* edit_buffer, vector<string>& completions) {
+        auto args = split(edit_buffer, ' ');
+        if(args.size() != 2 || !(is_prefix(args[0], "break") || is_prefix(args[0], "symbol"))) {
+            return;
+        }
+
+        set<string> names;
+        for(auto& symbol: m_symbols.lookup_prefix(args[1])) {
+            if(symbol.type == symbol_type::func) {
+                names.insert(symbol.name);
+            }
+        }
+
+        // Plain names of C++ functions, once the background indexing is done
+        for(auto entry: m_indexer ? vector<const name_index::entry*>{} : m_names.lookup_prefix(args[1])) {
+            if(entry->name_kind == name_index::kind::function || entry->name_kind == name_index::kind::global) {
+                names.emplace(entry->name);
+            }
+        }
+
+        for(auto& name: names) {
+            completions.push_back(args[0] + " " + name);
+        }
+    });
 
     string line = "";
     
@@ -114,329 +440,2185 @@ void debugger::run() {
 
         if(quit) break;
 
-        runCommand(line);
+        try {
+            runCommand(line);
+        } catch(runtime_error& e) {
+            cerr<<e.what()<<"\n";
+        }
         linenoise::AddHistory(line.c_str());
     }
 
-}
+    // A process the debugger attached to keeps running after it quits
+    if(m_attached && !m_exited) {
+        detach();
+    }
 
-void debugger::runCommand(const string& line) {
+    // Background work left when quitting, like saving the index
+    m_events.run_idle_tasks();
+    m_trace.close();
 
-    auto args = split(line, ' ');
-    auto input_command = args[0];
+    if(!m_traced_functions.empty() && !m_calltrace_reported) {
+        print_calltrace();
+    }
 
-    if (is_prefix(input_command, "continue")) {
-        continue_execution();
-    } else if (is_prefix(input_command, "break")) {
-        if (args[1][0] == '0' && args[1][1] == 'x') {
-            // Removing first 2 char from address as it contains 0x
-            string addr {args[1], 2};
-
-            // Taking first 16 bytes from the address
-            auto m_addr = stol(addr, 0, 16);
-            addBreakpoint(m_addr);
-        } else if (args[1].find(':') != string::npos) {
-            // This is for line number breakpoint: <filename>:<line>
-            auto file_and_line = split(args[1], ':');
-            set_bp_at_source_line(file_and_line[0], stoi(file_and_line[1]));
-        } else {
-            // This is for setting breakpoint on function
-            set_bp_at_func(args[1]);
-        }
-    } else if (is_prefix(input_command, "register")) {
-        if (is_prefix(args[1], "dump")) {
-            dump_registers();
-        } else if (is_prefix(args[1], "read")) {
-            cout<<get_register_value_from_type(m_pid, get_register_type_from_name(args[2]))<<endl;
-        } else if (is_prefix(args[1], "write")) {
-            string val {args[3], 2};
-            set_register_value(m_pid, get_register_type_from_name(args[2]), stol(val, 0, 16));
-        }
-    } else if (is_prefix(input_command, "memory")) {
-        string addr {args[2], 2};
+}
 
-        if(is_prefix(args[1], "read")) {
-            cout<<"READ: "<<read_memory(stol(addr, 0, 16))<<endl;
-        } else if(is_prefix(args[1], "write")) {
-            string value {args[3], 2};
-            write_memory(stol(addr, 0, 16), stol(value, 0, 16));
-        }
+// Attaches to every thread of a running process with PTRACE_SEIZE and stops them
+bool debugger::attach() {
 
-    } else if (is_prefix(input_command, "stepinst")) {
-        
-        single_step_instruction_with_bp_check();
-        auto line_entry = get_line_entry_using_pc(get_program_counter());
-        print_source(line_entry->file->path, line_entry->line, 2);
+    m_attached = true;
+    set<pid_t> seized;
 
-    } else if (is_prefix(input_command, "step")) {
-        step_in();
-    } else if (is_prefix(input_command, "next")) {
-        step_over();
-    } else if (is_prefix(input_command, "finish")) {
-        step_out();
-    } else if (is_prefix(input_command, "symbol")) {
-        auto symbols = lookup_symbol(args[1]);
-        for(auto& symbol: symbols) {
-            cout<<symbol.name<<" "<<to_string(symbol.type)<<" address 0x"<<hex<<symbol.address<<endl;
+    // Threads can be created while attaching, so the task list is read again until it has no new thread.
+    // Threads cloned by an already seized thread are attached by the kernel.
+    for(bool found = true; found;) {
+        found = false;
+
+        auto dir = opendir(("/proc/" + to_string(m_pid) + "/task").c_str());
+        if(dir == nullptr) {
+            cerr<<"Cannot find process "<<m_pid<<"!!!\n";
+            return false;
         }
-    } else if (is_prefix(input_command, "backtrace")) {
-        print_backtrace();
-    } else if (is_prefix(input_command, "variables")) {
-        read_variables();
-    } else {
-        cerr<<"No command found!! \n";
-    }
 
-}
+        while(auto entry = readdir(dir)) {
+            if(entry->d_name[0] == '.') {
+                continue;
+            }
 
-uint64_t debugger::read_memory(uint64_t addr) {
-    return ptrace(PTRACE_PEEKDATA, m_pid, addr, nullptr);
-}
+            pid_t tid = stoi(entry->d_name);
+            if(seized.count(tid) || (m_threads.count(tid) && m_threads.at(tid).stop_requested)) {
+                continue;
+            }
 
-void debugger::write_memory(uint64_t addr, uint64_t value) {
-    ptrace(PTRACE_POKEDATA, m_pid, addr, value);
-}
+            if(ptrace(PTRACE_SEIZE, tid, nullptr, PTRACE_O_TRACECLONE | PTRACE_O_TRACESYSGOOD) < 0) {
+                if(tid == m_pid) {
+                    cerr<<"Cannot attach to process "<<m_pid<<": "<<strerror(errno)<<"!!!\n";
+                    closedir(dir);
+                    return false;
+                }
+                // The thread exited meanwhile
+                continue;
+            }
 
-void debugger::continue_execution() {
+            ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr);
+            seized.insert(tid);
+            m_threads.emplace(tid, tracee_thread{tid}).first->second.stop_requested = true;
+            found = true;
+        }
 
-    step_over_breakpoint();
-    ptrace(PTRACE_CONT, m_pid, nullptr, nullptr);
+        closedir(dir);
+    }
 
-    wait_for_signal();
+    // Collects the interrupt stop of every thread
+    stop_other_threads();
+    switch_thread(m_pid);
+
+    cout<<"Attached to process "<<dec<<m_pid<<" ("<<m_threads.size()<<" threads) at 0x"<<hex<<get_program_counter()<<endl;
+    return true;
 
 }
 
-void debugger::addBreakpoint(intptr_t addr) {
+// Removes every breakpoint and lets all threads go, with the signals they were stopped by
+void debugger::detach() {
 
-    cout<<"Set breakpoint at address 0x"<<hex<<addr<<endl;
-    breakpoint bp{m_pid, addr};
-    bp.enable();
-    addr_to_bp[addr] = bp;
+    stop_other_threads();
 
-}
+    vector<intptr_t> enabled;
+    for(auto& bp: addr_to_bp) {
+        if(bp.second.is_enabled()) {
+            enabled.push_back(bp.first);
+        }
+    }
+    patch_breakpoints(enabled, false);
+    addr_to_bp.clear();
+    m_bp_actions.clear();
+    m_conditions.clear();
+    m_tracepoints.clear();
+    m_calltrace_entries.clear();
+    m_calltrace_returns.clear();
+    m_calltrace_user_returns.clear();
+    m_pending_calls.clear();
+
+    for(unsigned slot = 0; slot < hw_debug_registers::slot_count; slot++) {
+        m_hw_breakpoints.clear(slot);
+    }
 
-void debugger::dump_registers() {
+    for(auto& entry: m_threads) {
+        auto& thread = entry.second;
 
-    for (const auto& rg: registers) {
-        cout<<"Register "<<rg.name<<" "<<get_register_value_from_type(m_pid, rg.r_type)<<endl;
+        if(thread.has_pending_event) {
+            auto& event = thread.pending_event;
+            if(event.si_signo == SIGTRAP && (event.si_code == SI_KERNEL || event.si_code == TRAP_BRKPT)) {
+                // The int3 was executed, the thread has to run the restored instruction
+                thread.registers.set(register_type::rip, thread.registers.get(register_type::rip) - 1);
+            } else if(event.si_signo != SIGTRAP) {
+                thread.pending_signal = event.si_signo;
+            }
+            thread.has_pending_event = false;
+        }
+
+        thread.registers.flush();
+        m_hw_breakpoints.sync(thread.tid);
+        ptrace(PTRACE_DETACH, thread.tid, nullptr, reinterpret_cast<void*>(static_cast<intptr_t>(thread.pending_signal)));
     }
 
-}
+    if(m_pid_fd >= 0) {
+        m_events.remove(m_pid_fd);
+        close(m_pid_fd);
+        m_pid_fd = -1;
+    }
 
-uint64_t debugger::get_program_counter() {
-    return get_register_value_from_type(m_pid, register_type::rip);
-}
+    // Nothing can be run any more, same as after an exit
+    m_exited = true;
+    cout<<"Detached from process "<<dec<<m_pid<<endl;
 
-void debugger::set_program_counter(uint64_t pc) {
-    set_register_value(m_pid, register_type::rip, pc);
 }
 
-void debugger::wait_for_signal() {
-    int wait_status;
+// SIGINT and SIGCHLD are received through a signalfd, and the exit of the tracee through a pidfd, so that
+// waiting for the tracee can also serve Ctrl-C, stdin and background work
+void debugger::setup_event_loop() {
 
-    // wait for process to change state
-    waitpid(m_pid, &wait_status, 0);
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
 
-    auto signal = get_signal_info();
+    m_signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if(m_signal_fd >= 0) {
+        m_events.add(m_signal_fd, [this]() { handle_signalfd(); });
+    }
 
-    switch(signal.si_signo) {
-        case SIGTRAP:
-            handle_bptrap(signal);
-            break;
-        case SIGSEGV:
-            cout<<"Segmentation Fault caused because of "<<signal.si_code<<endl;
-            break;
-        default:
-            cout<<"Signal: "<<signal.si_code<<endl;
+    // Only wakes the loop up, the exit status is collected by waitpid
+    m_pid_fd = syscall(SYS_pidfd_open, m_pid, 0);
+    if(m_pid_fd >= 0) {
+        m_events.add(m_pid_fd, []() {});
     }
 
+    m_events.add(STDIN_FILENO, [this]() { handle_stdin(); });
+
 }
 
-void debugger::handle_bptrap(siginfo_t sig_info) {
+void debugger::handle_signalfd() {
 
-    switch(sig_info.si_code){
-        case SI_KERNEL:
-        case TRAP_BRKPT:
-        {
-            set_program_counter(get_program_counter() - 1);
-            cout<<"Breakpoint at address 0x"<<hex<<get_program_counter()<<endl;
-            auto offset = get_offset_load_address(get_program_counter());
-            auto line_entry = get_line_entry_using_pc(offset);
-            print_source(line_entry->file->path, line_entry->line, 2);
-            break;
+    signalfd_siginfo info;
+    while(read(m_signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        // SIGCHLD only wakes the loop up, the stop is collected by waitpid
+        if(info.ssi_signo == SIGINT) {
+            interrupt();
         }
-        case TRAP_TRACE:
-            break;
-        default:
-            cout<<"Unknown trap!!"<<endl;
     }
-    return;
 
 }
 
-void debugger::step_over_breakpoint() {
+// Input while the tracee runs, the prompt only comes back once it stops
+void debugger::handle_stdin() {
 
-    if(addr_to_bp.count(get_program_counter())) {
-        auto& breakpoint = addr_to_bp[get_program_counter()];
+    char buffer[256];
+    auto bytes = read(STDIN_FILENO, buffer, sizeof(buffer));
+    if(bytes <= 0) {
+        m_events.remove(STDIN_FILENO);
+        return;
+    }
 
-        if (breakpoint.is_enabled()) {breakpoint.disable();
-            ptrace(PTRACE_SINGLESTEP, m_pid, 0, nullptr);
-            wait_for_signal();
-            breakpoint.enable();
-        }
+    if(string{buffer, static_cast<size_t>(bytes)}.find("interrupt") != string::npos) {
+        interrupt();
+    } else {
+        cerr<<"The program is running, use interrupt or Ctrl-C to stop it!!!\n";
     }
+
 }
 
-void debugger::initialize_load_address() {
+// The tracee runs in its own process group, so Ctrl-C only reaches the debugger which forwards it
+// to the thread that was resumed
+void debugger::interrupt() {
 
-    // This checks whether the file is dynamic library
-    if(m_elf.get_hdr().type == elf::et::dyn) {   
-        // Load address is present at /proc/process_pid/maps file
-        ifstream map("/proc/" + to_string(m_pid) + "/maps");
+    if(m_waiting && !m_interrupt_sent) {
+        syscall(SYS_tgkill, m_pid, m_tid, SIGINT);
+        m_interrupt_sent = true;
+    }
+
+}
 
-        // The first in the file is the load address
-        string address;
-        getline(map, address, '-');
+// Runs the event loop until a thread stops with an event to report: the current thread, or any thread when
+// any_thread is set. Returns false if the program (or the waited thread) exited instead.
+bool debugger::wait_for_stop(bool any_thread) {
 
-        m_load_address = stol(address, 0, 16);
+    if(m_exited) {
+        return false;
     }
-}
 
-uint64_t debugger::get_offset_load_address(uint64_t addr) {
-    return addr - m_load_address;
-}
+    auto waited = any_thread ? -1 : m_tid;
+    bool stopped = false;
 
-dwarf::die debugger::get_func_using_pc(uint64_t pc) {
+    m_waiting = true;
+    m_interrupt_sent = false;
 
-    // Iterating through all the compile units
-    for(auto &compile_units: m_dwarf.compilation_units()) {
-        // Checking if program counter is between DW_AT_low_pc and DW_AT_high_pc
-        if(dwarf::die_pc_range(compile_units.root()).contains(pc)) {
-            // Iterating through all DWARF information entries (die) in compile unit
-            for(auto &die: compile_units.root()) {
-                // Checking if the die is a function (as it can be variable or any other type)
-                if(die.tag == dwarf::DW_TAG::subprogram) {
-                    // Checking if program counter is between DW_AT_low_pc and DW_AT_high_pc
-                    if(dwarf::die_pc_range(die).contains(pc)) {
-                        return die;
-                    }
+    while(!m_exited && !stopped) {
+        int wait_status;
+        auto tid = waitpid(-1, &wait_status, WNOHANG | __WALL);
+
+        if(tid == 0) {
+            m_events.run_once();
+            continue;
+        }
+
+        if(tid < 0) {
+            m_exited = true;
+            break;
+        }
+
+        if(!handle_thread_event(tid, wait_status)) {
+            auto iter = m_threads.find(tid);
+            if(iter == m_threads.end() || m_exited) {
+                // The waited thread is gone
+                if(tid == waited) {
+                    switch_thread(m_pid);
+                    break;
                 }
+                continue;
+            }
+
+            // Internal stops: the thread goes on if it is allowed to run
+            if(m_non_stop || waited == -1 || tid == waited) {
+                resume_thread(iter->second, PTRACE_CONT);
             }
+            continue;
+        }
+
+        // Another thread stopped while only the current one was meant to run, it is reported later
+        if(waited != -1 && tid != waited) {
+            auto& thread = m_threads.at(tid);
+            ptrace(PTRACE_GETSIGINFO, tid, nullptr, &thread.pending_event);
+            thread.has_pending_event = true;
+            continue;
         }
+
+        switch_thread(tid);
+        stopped = true;
     }
 
-    throw out_of_range{"Function not found!!!"};
+    m_waiting = false;
+
+    if(stopped && !m_non_stop) {
+        stop_other_threads();
+    }
+
+    return stopped;
+
 }
 
-dwarf::line_table::iterator debugger::get_line_entry_using_pc(uint64_t pc) {
+// Updates the state of the thread a wait status is about. Returns true if it is a stop to report to
+// the user, and false for exits and for the stops the debugger handles itself.
+bool debugger::handle_thread_event(pid_t tid, int wait_status) {
 
-    for(auto &compile_units: m_dwarf.compilation_units()) {
-        if(dwarf::die_pc_range(compile_units.root()).contains(pc)) {
-            auto& line_table = compile_units.get_line_table();
-            auto iterator = line_table.find_address(pc);
+    if(WIFEXITED(wait_status) || WIFSIGNALED(wait_status)) {
+        m_hw_breakpoints.remove_thread(tid);
 
-            if(iterator == line_table.end()) {
-                throw out_of_range{"11Line Table not found!!!"};
+        // The thread group leader is reported last, once the whole program is gone
+        if(tid == m_pid) {
+            if(WIFEXITED(wait_status)) {
+                cout<<"Program exited with status "<<dec<<WEXITSTATUS(wait_status)<<endl;
             } else {
-                return iterator;
+                cout<<"Program terminated by signal "<<dec<<WTERMSIG(wait_status)<<endl;
             }
+            if(m_pid_fd >= 0) {
+                m_events.remove(m_pid_fd);
+                close(m_pid_fd);
+                m_pid_fd = -1;
+            }
+            m_exited = true;
+            return false;
         }
-    }
 
-    throw out_of_range{"Line Table not found!!!"};
-}
+        cout<<"Thread "<<dec<<tid<<" exited"<<endl;
+        m_threads.erase(tid);
+        return false;
+    }
 
-void debugger::print_source(string file_name, unsigned line, unsigned context_size) {
+    auto iter = m_threads.find(tid);
+    if(iter == m_threads.end()) {
+        // The first stop of a new thread can come before the clone event of its parent
+        iter = m_threads.emplace(tid, tracee_thread{tid}).first;
+        iter->second.stop_requested = true;
+    }
 
-    ifstream file {file_name};
+    auto& thread = iter->second;
+    thread.stopped = true;
+    thread.registers.invalidate();
 
-    // Defining the start and end of window around line to print
-    auto start_line = (line > context_size) ? (line - context_size) : 1;
-    auto end_line = line + context_size + ((context_size > line) ? (context_size - line) : 0) + 1;
+    if((wait_status >> 16) == PTRACE_EVENT_CLONE) {
+        unsigned long new_tid;
+        ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &new_tid);
 
-    char c{};
-    auto current = 1u;
-    while(current != start_line && file.get(c)) {
-        if(c == '\n') {
-            current++;
+        if(!m_threads.count(new_tid)) {
+            m_threads.emplace(new_tid, tracee_thread{static_cast<pid_t>(new_tid)}).first->second.stop_requested = true;
         }
+        cout<<"New thread "<<dec<<new_tid<<endl;
+        return false;
     }
 
-    if(current == line) {
-        cout<<"> ";
-    }else{
-        cout<<" ";
+    // Threads of a seized process report PTRACE_EVENT_STOP instead of SIGSTOP
+    if((WSTOPSIG(wait_status) == SIGSTOP || (wait_status >> 16) == PTRACE_EVENT_STOP) && thread.stop_requested) {
+        thread.stop_requested = false;
+        return false;
     }
 
-    while(current <= end_line && file.get(c)) {
-        cout<<c;
-        if(c == '\n'){
-            current++;
-            cout<<(current == line) ? "> " : " ";
+    if(WSTOPSIG(wait_status) == (SIGTRAP | 0x80) || (wait_status >> 16) == PTRACE_EVENT_SECCOMP) {
+        return handle_syscall_stop(thread);
+    }
+
+    // A program started by the debugger stops at its exec in the middle of the execve system call, whose
+    // entry came before the debugger attached
+    if((wait_status >> 16) == PTRACE_EVENT_EXEC) {
+        if(m_catch_syscalls && !thread.in_syscall) {
+            thread.in_syscall = true;
+            thread.syscall_number = SYS_execve;
+            thread.syscall_start = chrono::steady_clock::now();
+            thread.syscall_args = "\"" + m_prog_name + "\", ...";
         }
+        return false;
     }
 
-    cout<<endl;
-}
+    return true;
 
-siginfo_t debugger::get_signal_info() {
-    siginfo_t s_info;
-    ptrace(PTRACE_GETSIGINFO, m_pid, nullptr, &s_info);
-    return s_info;
 }
 
-void debugger::single_step_instruction() {
-    ptrace(PTRACE_SINGLESTEP, m_pid, nullptr, nullptr);
-    wait_for_signal();
-}
+// All-stop mode: halts the threads still running once one of them stopped. Stops of other kinds
+// collected on the way are kept as pending events.
+void debugger::stop_other_threads() {
 
-void debugger::single_step_instruction_with_bp_check() {
-    if(addr_to_bp.count(get_program_counter())) {
-        step_over_breakpoint();
-    } else {
-        single_step_instruction();
+    for(auto& entry: m_threads) {
+        auto& thread = entry.second;
+        if(!thread.stopped && !thread.stop_requested) {
+            syscall(SYS_tgkill, m_pid, thread.tid, SIGSTOP);
+            thread.stop_requested = true;
+        }
     }
-}
 
-// For stepping out, set breakpoint at return address and continue execution from there
-void debugger::step_out() {
+    auto all_stopped = [this]() {
+        return all_of(m_threads.begin(), m_threads.end(), [](auto&& entry) { return entry.second.stopped; });
+    };
 
-    auto frame_pointer = get_register_value_from_type(m_pid, register_type::rbp);
-    auto return_address = read_memory(frame_pointer + 8);
+    while(!m_exited && !all_stopped()) {
+        int wait_status;
+        auto tid = waitpid(-1, &wait_status, __WALL);
+        if(tid < 0) {
+            break;
+        }
 
-    bool remove_bp = false;
-    if(addr_to_bp.count(return_address) == 0) {
-        addBreakpoint(return_address);
-        remove_bp = true;
+        if(handle_thread_event(tid, wait_status)) {
+            auto& thread = m_threads.at(tid);
+            ptrace(PTRACE_GETSIGINFO, tid, nullptr, &thread.pending_event);
+            thread.has_pending_event = true;
+        }
     }
 
-    continue_execution();
-
-    if (remove_bp) {
-        remove_breakpoint(return_address);
-    }
+    m_memory.invalidate();
 
 }
 
-void debugger::remove_breakpoint(intptr_t addr) {
-    if(addr_to_bp.at(addr).is_enabled()) {
-        addr_to_bp.at(addr).disable();
-    }
-    addr_to_bp.erase(addr);
-}
+// Lets the other stopped threads run. A thread sitting on a breakpoint it reported first executes the
+// original instruction, with the breakpoint removed while no other thread runs.
+void debugger::resume_other_threads() {
 
-// For step_in, step over instruction till we reach the new line
-void debugger::step_in() {
-    auto line = get_line_entry_using_pc(get_offset_program_counter())->line;
+    vector<pid_t> exited;
 
-    while(get_line_entry_using_pc(get_offset_program_counter())->line == line) {
-        single_step_instruction_with_bp_check();
-    }
+    for(auto& entry: m_threads) {
+        auto& thread = entry.second;
+        if(thread.tid == m_tid || !thread.stopped || thread.has_pending_event) {
+            continue;
+        }
 
+        auto pc = thread.registers.get(register_type::rip);
+        auto bp = addr_to_bp.find(pc);
+        if(bp != addr_to_bp.end() && bp->second.is_enabled()) {
+            patch_breakpoints({static_cast<intptr_t>(pc)}, false);
+            resume_thread(thread, PTRACE_SINGLESTEP);
+
+            int wait_status;
+            waitpid(thread.tid, &wait_status, __WALL);
+            patch_breakpoints({static_cast<intptr_t>(pc)}, true);
+
+            if(!WIFSTOPPED(wait_status)) {
+                exited.push_back(thread.tid);
+                continue;
+            }
+
+            thread.stopped = true;
+            if((WSTOPSIG(wait_status) == SIGSTOP || (wait_status >> 16) == PTRACE_EVENT_STOP) && thread.stop_requested) {
+                thread.stop_requested = false;
+            } else if(WSTOPSIG(wait_status) != SIGTRAP) {
+                thread.pending_signal = WSTOPSIG(wait_status);
+            }
+        }
+
+        resume_thread(thread, PTRACE_CONT);
+    }
+
+    for(auto tid: exited) {
+        m_hw_breakpoints.remove_thread(tid);
+        m_threads.erase(tid);
+    }
+
+    m_memory.invalidate();
+
+}
+
+// Reports the oldest stop collected while other threads were halted, instead of resuming anything
+bool debugger::report_pending_event() {
+
+    for(auto& entry: m_threads) {
+        auto& thread = entry.second;
+        if(!thread.has_pending_event) {
+            continue;
+        }
+        thread.has_pending_event = false;
+
+        auto& event = thread.pending_event;
+        auto pc = thread.registers.get(register_type::rip);
+
+        // The breakpoint was removed since, the thread only has to run the restored instruction again
+        if(event.si_signo == SIGTRAP && (event.si_code == SI_KERNEL || event.si_code == TRAP_BRKPT) && !addr_to_bp.count(pc - 1)) {
+            thread.registers.set(register_type::rip, pc - 1);
+            continue;
+        }
+
+        switch_thread(thread.tid);
+
+        auto action = m_bp_actions.find(pc - 1);
+        if(event.si_signo == SIGTRAP && (event.si_code == SI_KERNEL || event.si_code == TRAP_BRKPT) && action != m_bp_actions.end()) {
+            set_program_counter(pc - 1);
+            // The thread steps over the breakpoint when it is resumed
+            if(run_breakpoint_action(pc - 1)) {
+                continue;
+            }
+            cout<<"[Thread "<<dec<<m_tid<<"] ";
+            report_breakpoint();
+            return true;
+        }
+
+        cout<<"[Thread "<<dec<<m_tid<<"] ";
+        handle_signal(event);
+        return true;
+    }
+
+    return false;
+
+}
+
+void debugger::switch_thread(pid_t tid) {
+    m_tid = tid;
+    m_registers = &m_threads.at(tid).registers;
+}
+
+void debugger::print_threads() {
+
+    for(auto& entry: m_threads) {
+        auto& thread = entry.second;
+        cout<<(thread.tid == m_tid ? "* " : "  ")<<dec<<thread.tid;
+        if(thread.stopped) {
+            auto pc = thread.registers.get(register_type::rip);
+            cout<<" stopped at 0x"<<hex<<pc<<" in "<<symbolize(pc);
+        } else {
+            cout<<" running";
+        }
+        cout<<endl;
+    }
+
+    cout<<"Mode: "<<(m_non_stop ? "non-stop" : "all-stop")<<endl;
+
+}
+
+void debugger::runCommand(const string& line) {
+
+    auto args = split(line, ' ');
+    auto input_command = args[0];
+
+    finish_indexing(false);
+
+    if (m_exited && !is_prefix(input_command, "symbol") && !is_prefix(input_command, "stats") && !is_prefix(input_command, "trace") && !is_prefix(input_command, "calltrace")) {
+        cerr<<"No program is being debugged!!!\n";
+        return;
+    }
+
+    // Running threads can change memory between two commands
+    if (m_non_stop) {
+        m_memory.invalidate();
+    }
+
+    if (is_prefix(input_command, "continue")) {
+        continue_execution();
+    } else if (is_prefix(input_command, "break")) {
+        // break LOCATION if EXPR
+        auto condition = line.find(" if ");
+        auto existing = get_breakpoint_addresses();
+        m_new_breakpoints.clear();
+        set_breakpoint(args[1]);
+
+        if (condition != string::npos) {
+            set_condition(m_new_breakpoints, existing, line.substr(condition + 4));
+        } else {
+            // A return breakpoint of calltrace is shared with the user instead of swallowing the hits
+            for (auto addr: m_new_breakpoints) {
+                if (m_calltrace_returns.count(addr)) {
+                    m_calltrace_user_returns.insert(addr);
+                }
+            }
+        }
+    } else if (is_prefix(input_command, "hbreak")) {
+        string addr {args[1], 2};
+        add_hw_breakpoint(stol(addr, 0, 16), hw_break_type::execute, 1);
+    } else if (is_prefix(input_command, "watch")) {
+        if (is_prefix(args[1], "delete")) {
+            m_hw_breakpoints.clear(stoul(args[2]));
+            return;
+        }
+
+        string addr {args[1], 2};
+        auto len = (args.size() > 2) ? stoul(args[2], 0, 0) : 8;
+
+        // x86 can't trap on reads only, so read watchpoints also trap on writes
+        auto type = hw_break_type::write;
+        if (args.size() > 3 && args[3].find('r') != string::npos) {
+            type = hw_break_type::read_write;
+        }
+
+        add_hw_breakpoint(stol(addr, 0, 16), type, len);
+    } else if (is_prefix(input_command, "register")) {
+        if (is_prefix(args[1], "dump")) {
+            dump_registers();
+        } else if (is_prefix(args[1], "read")) {
+            cout<<get_register_value_from_type(*m_registers, get_register_type_from_name(args[2]))<<endl;
+        } else if (is_prefix(args[1], "write")) {
+            string val {args[3], 2};
+            set_register_value(*m_registers, get_register_type_from_name(args[2]), stol(val, 0, 16));
+        } else if (is_prefix(args[1], "stats")) {
+            cout<<dec<<"PTRACE_GETREGS: "<<m_registers->get_getregs_calls()<<" PTRACE_SETREGS: "<<m_registers->get_setregs_calls()
+                <<" Saved calls: "<<m_registers->get_saved_calls()<<endl;
+        }
+    } else if (is_prefix(input_command, "memory")) {
+        if(is_prefix(args[1], "stats")) {
+            cout<<dec<<"Read syscalls: "<<m_memory.get_read_syscalls()<<" Cached page hits: "<<m_memory.get_page_hits()<<endl;
+            return;
+        }
+
+        string addr {args[2], 2};
+
+        if(is_prefix(args[1], "read") && args.size() > 3) {
+            dump_memory(stol(addr, 0, 16), stoul(args[3], 0, 0));
+        } else if(is_prefix(args[1], "read")) {
+            cout<<"READ: "<<read_memory(stol(addr, 0, 16))<<endl;
+        } else if(is_prefix(args[1], "write")) {
+            string value {args[3], 2};
+            write_memory(stol(addr, 0, 16), stol(value, 0, 16));
+        }
+
+    } else if (is_prefix(input_command, "stepinst")) {
+        
+        single_step_instruction_with_bp_check();
+        auto line_entry = get_line_entry_using_pc(get_program_counter());
+        print_source(line_entry->file->path, line_entry->line, 2);
+
+    } else if (is_prefix(input_command, "step")) {
+        step_in();
+    } else if (is_prefix(input_command, "next")) {
+        step_over();
+    } else if (is_prefix(input_command, "finish")) {
+        step_out();
+    } else if (is_prefix(input_command, "symbol") && args[1][0] == '0' && args[1][1] == 'x') {
+        // Reverse lookup of a runtime address
+        string addr {args[1], 2};
+        cout<<symbolize(stoul(addr, 0, 16))<<endl;
+    } else if (is_prefix(input_command, "symbol")) {
+        // Patterns with wildcards are matched as globs, anything else is an exact lookup
+        auto symbols = (args[1].find_first_of("*?[") != string::npos) ? m_symbols.lookup_glob(args[1]) : lookup_symbol(args[1]);
+        for(auto& symbol: symbols) {
+            cout<<symbol.name<<" "<<to_string(symbol.type)<<" address 0x"<<hex<<symbol.address<<endl;
+        }
+    } else if (is_prefix(input_command, "stats")) {
+        auto average = m_step_over_count ? chrono::duration_cast<chrono::microseconds>(m_step_over_time).count() / m_step_over_count : 0;
+        cout<<dec<<"next: "<<m_step_over_count<<" steps, average latency "<<average<<" us"<<endl;
+        cout<<"index: "<<(m_index_from_cache ? "loaded from cache" : "built")<<" in "
+            <<chrono::duration_cast<chrono::microseconds>(m_index_time).count()<<" us";
+        if(!m_index_from_cache) {
+            cout<<" by "<<m_index_threads<<" threads, "<<m_index_steals<<" compile units stolen";
+        }
+        cout<<endl;
+        if(m_indexer) {
+            cout<<"background index: running"<<endl;
+        } else if(m_background_index_time.count() != 0) {
+            cout<<"background index: built in "<<chrono::duration_cast<chrono::microseconds>(m_background_index_time).count()<<" us"<<endl;
+        }
+        cout<<"names: "<<m_names.size()<<" functions, variables and types"<<endl;
+        auto lookup_ns = m_function_lookup_time.count();
+        cout<<"function lookups: "<<m_function_lookups<<", average "<<(m_function_lookups ? lookup_ns / m_function_lookups : 0)<<" ns, "
+            <<(lookup_ns ? static_cast<uint64_t>(m_function_lookups * 1e9 / lookup_ns) : 0)<<" lookups/s"<<endl;
+        cout<<"unwind: "<<m_unwinder.get_cached_rows()<<" cached CFI rows"<<endl;
+        cout<<"modules: "<<m_modules.size()<<" shared libraries"<<endl;
+        auto resume_latency = m_auto_resumes ? chrono::duration_cast<chrono::nanoseconds>(m_auto_resume_time).count() / m_auto_resumes : 0;
+        cout<<"conditions: "<<m_conditions.size()<<" breakpoints, "<<m_auto_resumes<<" hits resumed, average hit-to-resume latency "
+            <<resume_latency<<" ns, last continue "<<static_cast<uint64_t>(m_auto_resume_rate)<<" hits/s"<<endl;
+    } else if (is_prefix(input_command, "backtrace")) {
+        print_backtrace();
+    } else if (is_prefix(input_command, "variables")) {
+        read_variables();
+    } else if (is_prefix(input_command, "detach")) {
+        detach();
+    } else if (is_prefix(input_command, "thread")) {
+        if (args.size() < 2 || is_prefix(args[1], "list")) {
+            print_threads();
+        } else if (is_prefix(args[1], "mode") && args.size() > 2) {
+            m_non_stop = (args[2] == "non-stop");
+            if (!m_non_stop) {
+                stop_other_threads();
+            }
+            cout<<"Mode: "<<(m_non_stop ? "non-stop" : "all-stop")<<endl;
+        } else {
+            auto iter = m_threads.find(stoi(args[1]));
+            if (iter == m_threads.end() || !iter->second.stopped) {
+                cerr<<"Thread is not stopped or does not exist!!!\n";
+                return;
+            }
+            switch_thread(iter->first);
+            cout<<"Current thread "<<dec<<m_tid<<" at 0x"<<hex<<get_program_counter()<<" in "<<symbolize(get_program_counter())<<endl;
+        }
+    } else if (is_prefix(input_command, "sharedlibrary")) {
+        print_modules();
+    } else if (is_prefix(input_command, "catch")) {
+        if (args.size() < 2 || !is_prefix(args[1], "syscall")) {
+            cerr<<"Usage: catch syscall [names|off|stats]!!!\n";
+        } else if (args.size() == 3 && is_prefix(args[2], "stats")) {
+            m_syscall_stats.print();
+        } else {
+            set_catch_syscalls(vector<string>(args.begin() + 2, args.end()));
+        }
+    } else if (is_prefix(input_command, "calltrace")) {
+        if (args.size() < 2 || is_prefix(args[1], "report")) {
+            print_calltrace();
+        } else if (is_prefix(args[1], "stop")) {
+            stop_calltrace();
+        } else {
+            for (size_t i = 1; i < args.size(); i++) {
+                set_calltrace(args[i]);
+            }
+        }
+    } else if (is_prefix(input_command, "trace")) {
+        // trace LOCATION "format" args...
+        auto format_start = line.find('"');
+        auto format_end = line.rfind('"');
+        if (args.size() < 2 || (format_start == string::npos && is_prefix(args[1], "list"))) {
+            print_tracepoints();
+        } else if (format_start == string::npos && is_prefix(args[1], "show")) {
+            print_trace(args.size() > 2 ? stoul(args[2]) : 20);
+        } else if (format_start == string::npos || format_end == format_start) {
+            cerr<<"Usage: trace LOCATION \"format\" args...!!!\n";
+        } else {
+            istringstream rest {line.substr(format_end + 1)};
+            vector<string> arguments {istream_iterator<string>{rest}, istream_iterator<string>{}};
+            set_tracepoint(args[1], line.substr(format_start + 1, format_end - format_start - 1), arguments);
+        }
+    } else {
+        cerr<<"No command found!! \n";
+    }
+
+}
+
+uint64_t debugger::read_memory(uint64_t addr) {
+    return m_memory.read_word(addr);
+}
+
+void debugger::write_memory(uint64_t addr, uint64_t value) {
+    m_memory.write(addr, &value, sizeof(value));
+}
+
+// In all-stop mode continuing runs every thread, stepping commands only run the current one so that other
+// threads don't hit their temporary breakpoints. In non-stop mode only the current thread is resumed.
+void debugger::continue_execution(bool all_threads) {
+
+    if(all_threads && report_pending_event()) {
+        return;
+    }
+
+    auto continue_start = chrono::steady_clock::now();
+    chrono::steady_clock::time_point hit_time;
+    uint64_t auto_resumes = 0;
+    bool calltrace_event = false;
+
+    while(true) {
+        step_over_breakpoint();
+
+        if(all_threads && !m_non_stop) {
+            resume_other_threads();
+        }
+        resume(PTRACE_CONT);
+
+        // Hit-to-resume latency, including the step over the breakpoint
+        if(auto_resumes != 0) {
+            auto latency = chrono::steady_clock::now() - hit_time;
+            m_auto_resume_time += latency;
+            if(calltrace_event) {
+                m_calltrace_events++;
+                m_calltrace_overhead += latency;
+            }
+        }
+
+        if(!wait_for_stop(all_threads)) {
+            break;
+        }
+
+        auto signal = get_signal_info();
+
+        // Breakpoints with an action, like the one in the dynamic linker or a false condition, don't stop at the prompt
+        if(signal.si_signo == SIGTRAP && (signal.si_code == SI_KERNEL || signal.si_code == TRAP_BRKPT) &&
+           m_bp_actions.count(get_program_counter() - 1)) {
+            hit_time = chrono::steady_clock::now();
+            set_program_counter(get_program_counter() - 1);
+            calltrace_event = m_calltrace_entries.count(get_program_counter()) || m_calltrace_returns.count(get_program_counter());
+            if(run_breakpoint_action(get_program_counter())) {
+                auto_resumes++;
+                continue;
+            }
+            if(m_threads.size() > 1) {
+                cout<<"[Thread "<<dec<<m_tid<<"] ";
+            }
+            report_breakpoint();
+            break;
+        }
+
+        report_stop(signal);
+        break;
+    }
+
+    if(auto_resumes != 0) {
+        m_auto_resumes += auto_resumes;
+        m_auto_resume_rate = auto_resumes / chrono::duration<double>(chrono::steady_clock::now() - continue_start).count();
+    }
+
+    if(m_exited && !m_traced_functions.empty() && !m_calltrace_reported) {
+        print_calltrace();
+        m_calltrace_reported = true;
+    }
+
+}
+
+// Every PTRACE_CONT/PTRACE_SINGLESTEP goes through here so the register snapshot is written back before
+// the tracee runs, and registers and memory are refetched at the next stop
+void debugger::resume(__ptrace_request request, int signal) {
+
+    auto& thread = m_threads.at(m_tid);
+    if(signal != 0) {
+        thread.pending_signal = signal;
+    }
+
+    resume_thread(thread, request);
+    m_memory.invalidate();
+
+}
+
+void debugger::resume_thread(tracee_thread& thread, __ptrace_request request) {
+
+    // Caught system calls stop the thread at their entry and exit, a thread stopped at the entry of a
+    // system call only gets an exit stop with PTRACE_SYSCALL
+    if(request == PTRACE_CONT && (m_catch_syscalls || thread.in_syscall)) {
+        request = PTRACE_SYSCALL;
+    }
+    if(request != PTRACE_SYSCALL) {
+        thread.in_syscall = false;
+    }
+
+    thread.registers.flush();
+    m_hw_breakpoints.sync(thread.tid);
+
+    ptrace(request, thread.tid, nullptr, reinterpret_cast<void*>(static_cast<intptr_t>(thread.pending_signal)));
+
+    thread.pending_signal = 0;
+    thread.stopped = false;
+    thread.registers.invalidate();
+
+}
+
+void debugger::addBreakpoint(intptr_t addr) {
+
+    cout<<"Set breakpoint at address 0x"<<hex<<addr<<endl;
+
+    // Written through /proc/pid/mem, which unlike PTRACE_POKEDATA works while threads are running
+    if(!addr_to_bp.count(addr) || !addr_to_bp[addr].is_enabled()) {
+        addr_to_bp[addr] = breakpoint{m_pid, addr};
+        patch_breakpoints({addr}, true);
+    }
+    m_new_breakpoints.push_back(addr);
+
+}
+
+// The breakpoints set before a command, which the command must not take over or remove
+unordered_set<intptr_t> debugger::get_breakpoint_addresses() {
+
+    unordered_set<intptr_t> addrs;
+    for(auto& entry: addr_to_bp) {
+        addrs.insert(entry.first);
+    }
+    return addrs;
+
+}
+
+// Address, file:line or function name
+void debugger::set_breakpoint(const string& location) {
+
+    if (location[0] == '0' && location[1] == 'x') {
+        // Removing first 2 char from address as it contains 0x
+        string addr {location, 2};
+
+        // Taking first 16 bytes from the address
+        auto m_addr = stol(addr, 0, 16);
+        addBreakpoint(m_addr);
+    } else if (location.find(':') != string::npos) {
+        // This is for line number breakpoint: <filename>:<line>
+        auto file_and_line = split(location, ':');
+        set_bp_at_source_line(file_and_line[0], stoi(file_and_line[1]));
+    } else {
+        // This is for setting breakpoint on function
+        set_bp_at_func(location);
+    }
+
+}
+
+// Every argument is an expression like the conditions, evaluated when the tracepoint is hit
+void debugger::set_tracepoint(const string& location, const string& format, const vector<string>& arguments) {
+
+    if(arguments.size() > trace_log::max_values) {
+        cerr<<"A tracepoint records at most "<<trace_log::max_values<<" values!!!\n";
+        return;
+    }
+
+    if(!m_trace.is_open()) {
+        auto path = m_prog_name.substr(m_prog_name.rfind('/') + 1) + ".trace";
+        if(!m_trace.open(path)) {
+            cerr<<"Cannot open "<<path<<"!!!\n";
+            return;
+        }
+        m_trace_start = chrono::steady_clock::now();
+    }
+
+    auto existing = get_breakpoint_addresses();
+    m_new_breakpoints.clear();
+    set_breakpoint(location);
+
+    for(auto addr: m_new_breakpoints) {
+        if(m_tracepoints.count(addr)) {
+            continue;
+        }
+        if(existing.count(addr)) {
+            cerr<<"Breakpoint at 0x"<<hex<<addr<<" already set, not tracing there!!!\n";
+            continue;
+        }
+
+        tracepoint trace;
+        trace.id = m_next_tracepoint_id++;
+        trace.format = format;
+        try {
+            for(auto& argument: arguments) {
+                trace.arguments.push_back(expression::compile(argument, [this, addr, &trace](const string& name) {
+                    return resolve_variable(addr, name, trace.variables);
+                }));
+            }
+        } catch(exception& e) {
+            cerr<<e.what()<<"\n";
+            remove_breakpoint(addr);
+            continue;
+        }
+
+        m_trace.define(trace_log::definition{trace.id, static_cast<uint64_t>(addr), format, arguments});
+        cout<<"Tracepoint "<<dec<<trace.id<<" at address 0x"<<hex<<addr<<endl;
+
+        m_tracepoints[addr] = move(trace);
+        m_bp_actions[addr] = [this, addr]() {
+            return record_tracepoint(addr);
+        };
+    }
+
+}
+
+// Runs when a tracepoint is hit, the program always goes on
+bool debugger::record_tracepoint(intptr_t addr) {
+
+    auto& trace = m_tracepoints.at(addr);
+    condition_context context {m_pid, *m_registers, m_memory, m_load_address, trace.variables};
+
+    trace_log::event e;
+    e.id = trace.id;
+    e.tid = m_tid;
+    e.time = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - m_trace_start).count();
+    e.count = trace.arguments.size();
+    for(size_t i = 0; i < trace.arguments.size(); i++) {
+        // A value that cannot be read, like a null pointer, is recorded as 0
+        try {
+            e.values[i] = trace.arguments[i].evaluate(context);
+        } catch(exception&) {
+            e.values[i] = 0;
+        }
+    }
+
+    m_trace.record(e);
+    return true;
+
+}
+
+void debugger::print_tracepoints() {
+
+    for(auto& [addr, trace]: m_tracepoints) {
+        cout<<dec<<trace.id<<": 0x"<<hex<<addr<<" in "<<symbolize(addr)<<" \""<<trace.format<<"\" hit "
+            <<dec<<addr_to_bp.at(addr).get_hits()<<" times"<<endl;
+    }
+
+    if(m_trace.is_open()) {
+        cout<<dec<<m_trace.get_recorded()<<" events recorded, "<<m_trace.get_written()<<" written to "<<m_trace.get_path()
+            <<", "<<m_trace.get_dropped()<<" dropped"<<endl;
+    }
+
+}
+
+// The last events of the trace file, formatted
+void debugger::print_trace(size_t count) {
+
+    if(!m_trace.is_open()) {
+        cerr<<"No tracepoints!!!\n";
+        return;
+    }
+
+    m_trace.flush();
+
+    deque<string> lines;
+    auto complete = trace_log::read(m_trace.get_path(), [&lines, count](const trace_log::definition& trace, const trace_log::event& e) {
+        ostringstream line;
+        line<<"["<<e.time / 1000<<" us] "<<e.tid<<": "<<trace_log::format(trace.format, e.values, e.count);
+        lines.push_back(line.str());
+        if(lines.size() > count) {
+            lines.pop_front();
+        }
+    });
+
+    for(auto& line: lines) {
+        cout<<line<<endl;
+    }
+    if(!complete) {
+        cerr<<"Cannot read all of "<<m_trace.get_path()<<"!!!\n";
+    }
+
+}
+
+// Times every call of the function between the breakpoint after its prologue and one at its return address
+void debugger::set_calltrace(const string& location) {
+
+    // Breakpoints the user already has at the entry keep stopping the program
+    auto existing = get_breakpoint_addresses();
+
+    m_new_breakpoints.clear();
+    set_breakpoint(location);
+
+    vector<intptr_t> entries;
+    for(auto addr: m_new_breakpoints) {
+        if(m_calltrace_entries.count(addr)) {
+            continue;
+        }
+        if(existing.count(addr)) {
+            cerr<<"Breakpoint at 0x"<<hex<<addr<<" already set, not tracing calls there!!!\n";
+            continue;
+        }
+        entries.push_back(addr);
+    }
+    if(entries.empty()) {
+        return;
+    }
+
+    auto function = find_if(m_traced_functions.begin(), m_traced_functions.end(), [&location](auto&& traced) {
+        return traced.name == location;
+    }) - m_traced_functions.begin();
+    if(function == static_cast<ssize_t>(m_traced_functions.size())) {
+        m_traced_functions.push_back(traced_function{location, latency_histogram{}, 0});
+    }
+
+    for(auto addr: entries) {
+        m_calltrace_entries[addr] = function;
+        m_bp_actions[addr] = [this, addr]() {
+            return calltrace_entry(addr);
+        };
+    }
+
+}
+
+bool debugger::calltrace_entry(intptr_t addr) {
+
+    auto start = chrono::steady_clock::now();
+    auto& function = m_traced_functions[m_calltrace_entries.at(addr)];
+
+    // The caller's stack pointer is the one the return breakpoint is hit with
+    auto regs = get_unwind_registers();
+    if(!unwind_frame(regs, true)) {
+        function.untimed++;
+        return true;
+    }
+    intptr_t return_address = regs.values[unwind_registers::return_address];
+
+    if(!m_calltrace_returns.count(return_address)) {
+        if(addr_to_bp.count(return_address)) {
+            function.untimed++;
+            return true;
+        }
+
+        addr_to_bp[return_address] = breakpoint{m_pid, return_address};
+        patch_breakpoints({return_address}, true);
+        m_calltrace_returns.insert(return_address);
+        m_bp_actions[return_address] = [this, return_address]() {
+            return calltrace_return(return_address);
+        };
+    }
+
+    m_pending_calls[m_tid].push_back(pending_call{m_calltrace_entries.at(addr), static_cast<uint64_t>(return_address),
+                                                  regs.values[unwind_registers::rsp], start});
+    return true;
+
+}
+
+bool debugger::calltrace_return(intptr_t addr) {
+
+    auto now = chrono::steady_clock::now();
+    auto stack_pointer = get_register_value_from_type(*m_registers, register_type::rsp);
+    auto& calls = m_pending_calls[m_tid];
+
+    // Deeper frames that never returned were unwound by a longjmp or an exception
+    while(!calls.empty() && calls.back().stack_pointer < stack_pointer) {
+        m_traced_functions[calls.back().function].untimed++;
+        calls.pop_back();
+    }
+
+    if(!calls.empty() && calls.back().stack_pointer == stack_pointer && calls.back().return_address == static_cast<uint64_t>(addr)) {
+        auto latency = chrono::duration_cast<chrono::nanoseconds>(now - calls.back().start).count();
+        m_traced_functions[calls.back().function].latencies.record(latency);
+        calls.pop_back();
+    }
+
+    return !m_calltrace_user_returns.count(addr);
+
+}
+
+void debugger::print_calltrace() {
+
+    cout<<left<<setw(30)<<"function"<<right<<setw(10)<<"calls"<<setw(10)<<"mean"<<setw(10)<<"min"<<setw(10)<<"p50"
+        <<setw(10)<<"p90"<<setw(10)<<"p99"<<setw(10)<<"p99.9"<<setw(10)<<"max"<<setw(10)<<"untimed"<<endl;
+
+    for(auto& function: m_traced_functions) {
+        auto& latencies = function.latencies;
+        cout<<left<<setw(30)<<function.name<<right<<dec<<setw(10)<<latencies.get_count()
+            <<setw(10)<<latency_histogram::format_ns(latencies.get_mean())
+            <<setw(10)<<latency_histogram::format_ns(latencies.get_min());
+        for(auto percent: {50.0, 90.0, 99.0, 99.9}) {
+            cout<<setw(10)<<latency_histogram::format_ns(latencies.percentile(percent));
+        }
+        cout<<setw(10)<<latency_histogram::format_ns(latencies.get_max())<<setw(10)<<function.untimed<<endl;
+    }
+
+    // Every call is two events, its latency includes about one event of overhead
+    auto overhead = m_calltrace_events ? m_calltrace_overhead.count() / m_calltrace_events : 0;
+    cout<<dec<<m_calltrace_events<<" events, overhead "<<latency_histogram::format_ns(overhead)<<" per event (hit to resume)"<<endl;
+
+}
+
+void debugger::stop_calltrace() {
+
+    vector<intptr_t> addrs;
+    for(auto& entry: m_calltrace_entries) {
+        addrs.push_back(entry.first);
+    }
+    for(auto addr: m_calltrace_returns) {
+        if(!m_calltrace_user_returns.count(addr)) {
+            addrs.push_back(addr);
+        }
+    }
+
+    remove_breakpoints(addrs);
+
+    // The user's breakpoints become plain breakpoints
+    for(auto addr: m_calltrace_user_returns) {
+        m_bp_actions.erase(addr);
+    }
+    m_calltrace_returns.clear();
+    m_calltrace_user_returns.clear();
+    m_pending_calls.clear();
+    m_traced_functions.clear();
+    m_calltrace_events = 0;
+    m_calltrace_overhead = chrono::nanoseconds{0};
+    m_calltrace_reported = false;
+
+}
+
+// No names catches every system call, off stops catching them
+void debugger::set_catch_syscalls(const vector<string>& names) {
+
+    if(names.size() == 1 && names[0] == "off") {
+        m_catch_syscalls = false;
+        m_caught_syscalls.clear();
+        cout<<"Not catching system calls"<<endl;
+        return;
+    }
+
+    set<long> caught;
+    for(auto& name: names) {
+        auto number = find_syscall_number(name);
+        if(number < 0) {
+            cerr<<"Unknown system call "<<name<<"!!!\n";
+            return;
+        }
+        caught.insert(number);
+    }
+
+    m_catch_syscalls = true;
+    m_caught_syscalls = move(caught);
+
+    cout<<"Catching ";
+    if(m_caught_syscalls.empty()) {
+        cout<<"all system calls";
+    }
+    for(auto number: m_caught_syscalls) {
+        cout<<get_syscall_name(number)<<" ";
+    }
+    cout<<endl;
+
+}
+
+bool debugger::is_caught_syscall(long number) {
+    return m_caught_syscalls.empty() || m_caught_syscalls.count(number);
+}
+
+// Entry and exit stops alternate. Returns true if the stop is to be reported at the prompt.
+bool debugger::handle_syscall_stop(tracee_thread& thread) {
+
+    auto now = chrono::steady_clock::now();
+    auto& regs = thread.registers;
+
+    if(!thread.in_syscall) {
+        thread.in_syscall = true;
+        thread.syscall_number = regs.get(register_type::orig_rax);
+        thread.syscall_start = now;
+        if(!is_caught_syscall(thread.syscall_number)) {
+            return false;
+        }
+
+        // The memory can have changed since the last stop, threads were resumed without invalidating it
+        m_memory.invalidate();
+        thread.syscall_args = format_syscall_args(thread.syscall_number, get_syscall_args(regs), m_memory);
+        return !m_syscall_log;
+    }
+
+    thread.in_syscall = false;
+    int64_t result = regs.get(register_type::rax);
+    m_syscall_stats.record(thread.syscall_number, now - thread.syscall_start, result);
+
+    if(!is_caught_syscall(thread.syscall_number)) {
+        return false;
+    }
+
+    if(m_syscall_log) {
+        if(m_threads.size() > 1) {
+            cout<<"[Thread "<<dec<<thread.tid<<"] ";
+        }
+        cout<<get_syscall_name(thread.syscall_number)<<"("<<thread.syscall_args<<") = "<<format_syscall_result(result)
+            <<" <"<<fixed<<setprecision(6)<<chrono::duration<double>(now - thread.syscall_start).count()<<defaultfloat<<">"<<endl;
+        return false;
+    }
+
+    return true;
+
+}
+
+void debugger::report_syscall() {
+
+    auto& thread = m_threads.at(m_tid);
+    auto name = get_syscall_name(thread.syscall_number);
+
+    if(thread.in_syscall) {
+        cout<<"Syscall "<<name<<"("<<thread.syscall_args<<")";
+    } else {
+        cout<<"Syscall "<<name<<" returned "<<format_syscall_result(get_register_value_from_type(*m_registers, register_type::rax));
+    }
+    cout<<" at 0x"<<hex<<get_program_counter()<<" in "<<symbolize(get_program_counter())<<endl;
+
+}
+
+// strace-like mode: the program runs to its exit and the caught system calls are printed on their return.
+// With a seccomp filter only those system calls stop the program.
+void debugger::trace_syscalls(const set<long>& syscalls, bool filtered) {
+
+    m_catch_syscalls = !filtered;
+    m_caught_syscalls = syscalls;
+    m_syscall_log = true;
+
+    while(!m_exited) {
+        int wait_status;
+        auto tid = waitpid(-1, &wait_status, __WALL);
+        if(tid < 0) {
+            break;
+        }
+
+        auto reported = handle_thread_event(tid, wait_status);
+        auto iter = m_threads.find(tid);
+        if(m_exited || iter == m_threads.end()) {
+            continue;
+        }
+
+        // The remaining stops are signals for the program
+        if(reported && (wait_status >> 16) == 0) {
+            iter->second.pending_signal = WSTOPSIG(wait_status);
+        }
+        resume_thread(iter->second, PTRACE_CONT);
+    }
+
+    m_syscall_stats.print();
+
+}
+
+// Compiles the condition once for every address, the variables are looked up in the function of each address.
+// Breakpoints in existing were set before the command and are kept when the condition doesn't compile.
+void debugger::set_condition(const vector<intptr_t>& addrs, const unordered_set<intptr_t>& existing, const string& text) {
+
+    for(auto addr: addrs) {
+        // Tracepoints and calltrace breakpoints never stop the program
+        if(m_bp_actions.count(addr) && !m_conditions.count(addr)) {
+            cerr<<"Breakpoint at 0x"<<hex<<addr<<" is traced, not adding the condition there!!!\n";
+            continue;
+        }
+
+        breakpoint_condition condition;
+        try {
+            condition.condition = expression::compile(text, [this, addr, &condition](const string& name) {
+                return resolve_variable(addr, name, condition.variables);
+            });
+        } catch(exception& e) {
+            cerr<<e.what()<<"\n";
+            if(!existing.count(addr)) {
+                remove_breakpoint(addr);
+            }
+            continue;
+        }
+
+        m_conditions[addr] = move(condition);
+        m_bp_actions[addr] = [this, addr]() {
+            return check_condition(addr);
+        };
+        cout<<"Condition "<<text<<" at address 0x"<<hex<<addr<<endl;
+    }
+
+}
+
+// Locals and parameters of the function containing addr first, then global variables
+ssize_t debugger::resolve_variable(intptr_t addr, const string& name, vector<located_variable>& variables) {
+
+    dwarf::die found;
+    bool global = false;
+
+    try {
+        auto function = get_func_using_pc(get_offset_load_address(addr));
+        for(auto& die: function) {
+            if((die.tag == dwarf::DW_TAG::variable || die.tag == dwarf::DW_TAG::formal_parameter) && die.has(dwarf::DW_AT::name) &&
+               die.has(dwarf::DW_AT::location) && dwarf::at_name(die) == name) {
+                found = die;
+            }
+        }
+    } catch(out_of_range&) {}
+
+    if(!found.valid()) {
+        finish_indexing(true);
+        auto find_global = [this, &found, &global](const name_index::entry& entry) {
+            if(found.valid() || (entry.name_kind != name_index::kind::variable && entry.name_kind != name_index::kind::global)) {
+                return;
+            }
+            auto die = m_names.get_die(entry);
+            if(die.tag == dwarf::DW_TAG::variable && die.has(dwarf::DW_AT::location)) {
+                found = die;
+                global = true;
+            }
+        };
+
+        for(auto entry: m_names.lookup(name)) {
+            find_global(*entry);
+        }
+        // Static variables are not in .debug_pubnames
+        if(!found.valid() && m_names.from_pubnames()) {
+            for(auto entry: m_names.lookup_dies(name)) {
+                find_global(*entry);
+            }
+        }
+    }
+
+    // Location lists are not supported
+    if(!found.valid() || found[dwarf::DW_AT::location].get_type() != dwarf::value::type::exprloc) {
+        return -1;
+    }
+
+    located_variable variable{found[dwarf::DW_AT::location].as_exprloc(), 8, false, global};
+
+    // Size and signedness of the underlying type
+    if(found.has(dwarf::DW_AT::type)) {
+        auto type = found[dwarf::DW_AT::type].as_reference();
+        while((type.tag == dwarf::DW_TAG::typedef_ || type.tag == dwarf::DW_TAG::const_type || type.tag == dwarf::DW_TAG::volatile_type) &&
+              type.has(dwarf::DW_AT::type)) {
+            type = type[dwarf::DW_AT::type].as_reference();
+        }
+
+        if(type.has(dwarf::DW_AT::byte_size)) {
+            variable.size = min<uint64_t>(type[dwarf::DW_AT::byte_size].as_uconstant(), 8);
+        }
+        if(type.tag == dwarf::DW_TAG::base_type && type.has(dwarf::DW_AT::encoding)) {
+            auto encoding = static_cast<dwarf::DW_ATE>(type[dwarf::DW_AT::encoding].as_uconstant());
+            variable.is_signed = (encoding == dwarf::DW_ATE::signed_ || encoding == dwarf::DW_ATE::signed_char);
+        }
+    }
+
+    variables.push_back(variable);
+    return variables.size() - 1;
+
+}
+
+// Runs when a conditional breakpoint is hit, returns true to let the program go on
+bool debugger::check_condition(intptr_t addr) {
+
+    auto& condition = m_conditions.at(addr);
+    condition_context context {m_pid, *m_registers, m_memory, m_load_address, condition.variables};
+
+    try {
+        return condition.condition.evaluate(context) == 0;
+    } catch(exception& e) {
+        cerr<<"Cannot evaluate "<<condition.condition.get_text()<<": "<<e.what()<<"\n";
+        return false;
+    }
+
+}
+
+bool debugger::run_breakpoint_action(intptr_t addr) {
+
+    auto bp = addr_to_bp.find(addr);
+    if(bp != addr_to_bp.end()) {
+        bp->second.hit();
+    }
+
+    return m_bp_actions.at(addr)();
+
+}
+
+// Silently adds breakpoints at all addresses, the text of each page is read and written once
+void debugger::add_breakpoints(const vector<intptr_t>& addrs) {
+
+    for(auto addr: addrs) {
+        addr_to_bp[addr] = breakpoint{m_pid, addr};
+    }
+
+    patch_breakpoints(addrs, true);
+
+}
+
+void debugger::remove_breakpoints(const vector<intptr_t>& addrs) {
+
+    vector<intptr_t> enabled;
+    for(auto addr: addrs) {
+        if(addr_to_bp.at(addr).is_enabled()) {
+            enabled.push_back(addr);
+        }
+    }
+
+    patch_breakpoints(enabled, false);
+
+    for(auto addr: addrs) {
+        addr_to_bp.erase(addr);
+        m_conditions.erase(addr);
+        m_tracepoints.erase(addr);
+        m_calltrace_entries.erase(addr);
+        m_calltrace_returns.erase(addr);
+        m_calltrace_user_returns.erase(addr);
+        m_bp_actions.erase(addr);
+    }
+
+}
+
+void debugger::patch_breakpoints(const vector<intptr_t>& addrs, bool enable) {
+
+    // Group the patches by page
+    map<uint64_t, vector<intptr_t>> pages;
+    for(auto addr: addrs) {
+        pages[addr & ~(memory_cache::page_size - 1)].push_back(addr);
+    }
+
+    for(auto& page: pages) {
+        auto& page_addrs = page.second;
+        auto low = *min_element(page_addrs.begin(), page_addrs.end());
+        auto high = *max_element(page_addrs.begin(), page_addrs.end());
+
+        // The page can be gone, like the text of an unloaded library, and zeros must not become the saved bytes
+        vector<uint8_t> text(high - low + 1);
+        if(!m_memory.read(low, text.data(), text.size())) {
+            cerr<<"Cannot read memory at 0x"<<hex<<low<<", breakpoints of the page not "<<(enable ? "set" : "removed")<<"!!!\n";
+            continue;
+        }
+
+        for(auto addr: page_addrs) {
+            if(enable) {
+                addr_to_bp[addr].enable(text[addr - low]);
+            } else {
+                addr_to_bp[addr].disable(text[addr - low]);
+            }
+        }
+
+        m_memory.write(low, text.data(), text.size());
+    }
+
+}
+
+void debugger::dump_registers() {
+
+    for (const auto& rg: registers) {
+        cout<<"Register "<<rg.name<<" "<<get_register_value_from_type(*m_registers, rg.r_type)<<endl;
+    }
+
+}
+
+// Hex dump with 16 bytes per row, the whole range is fetched with one bulk read
+void debugger::dump_memory(uint64_t addr, size_t len) {
+
+    vector<uint8_t> data(len);
+    if(!m_memory.read(addr, data.data(), len)) {
+        cerr<<"Cannot read memory at 0x"<<hex<<addr<<"!!!\n";
+        return;
+    }
+
+    for(size_t row = 0; row < len; row += 16) {
+        cout<<"0x"<<hex<<setw(16)<<setfill('0')<<(addr + row)<<": ";
+
+        for(size_t i = row; i < row + 16; i++) {
+            if(i < len) {
+                cout<<setw(2)<<setfill('0')<<static_cast<unsigned>(data[i])<<" ";
+            } else {
+                cout<<"   ";
+            }
+        }
+
+        cout<<" |";
+        for(size_t i = row; i < min(row + 16, len); i++) {
+            cout<<(isprint(data[i]) ? static_cast<char>(data[i]) : '.');
+        }
+        cout<<"|"<<endl;
+    }
+
+    cout<<setfill(' ');
+
+}
+
+uint64_t debugger::get_program_counter() {
+    return get_register_value_from_type(*m_registers, register_type::rip);
+}
+
+void debugger::set_program_counter(uint64_t pc) {
+    set_register_value(*m_registers, register_type::rip, pc);
+}
+
+void debugger::wait_for_signal(bool any_thread) {
+
+    // wait for process to change state
+    if(!wait_for_stop(any_thread)) {
+        return;
+    }
+
+    report_stop(get_signal_info());
+
+}
+
+void debugger::report_stop(siginfo_t signal) {
+
+    if(m_threads.size() > 1) {
+        cout<<"[Thread "<<dec<<m_tid<<"] ";
+    }
+    handle_signal(signal);
+
+}
+
+// Waits for the tracee to stop without reporting breakpoint hits, any other stop is reported as usual
+bool debugger::wait_for_breakpoint() {
+
+    if(!wait_for_stop(false)) {
+        return false;
+    }
+
+    auto signal = get_signal_info();
+
+    if(signal.si_signo == SIGTRAP && (signal.si_code == SI_KERNEL || signal.si_code == TRAP_BRKPT)) {
+        set_program_counter(get_program_counter() - 1);
+        return true;
+    }
+
+    handle_signal(signal);
+    return false;
+
+}
+
+void debugger::handle_signal(siginfo_t signal) {
+
+    switch(signal.si_signo) {
+        case SIGTRAP:
+            handle_bptrap(signal);
+            break;
+        case SIGSEGV:
+            cout<<"Segmentation Fault caused because of "<<signal.si_code<<endl;
+            break;
+        case SIGINT:
+            cout<<"Program interrupted at 0x"<<hex<<get_program_counter()<<" in "<<symbolize(get_program_counter())<<endl;
+            break;
+        case SIGSYS:
+            cout<<"Bad system call "<<get_syscall_name(signal.si_syscall)<<" at 0x"<<hex<<get_program_counter()<<endl;
+            break;
+        default:
+            cout<<"Program received signal "<<strsignal(signal.si_signo)<<" ("<<dec<<signal.si_signo<<", code "<<signal.si_code<<")"<<endl;
+    }
+
+}
+
+void debugger::handle_bptrap(siginfo_t sig_info) {
+
+    switch(sig_info.si_code){
+        case SI_KERNEL:
+        case TRAP_BRKPT:
+            set_program_counter(get_program_counter() - 1);
+            if(addr_to_bp.count(get_program_counter())) {
+                addr_to_bp[get_program_counter()].hit();
+            }
+            report_breakpoint();
+            break;
+        case TRAP_HWBKPT:
+        {
+            // Instruction breakpoints are faults and watchpoints are traps, so the PC needs no adjustment
+            auto slot = m_hw_breakpoints.get_triggered_slot(m_tid);
+            if(slot < 0) {
+                cout<<"Unknown hardware trap!!"<<endl;
+                break;
+            }
+
+            auto& hw_slot = m_hw_breakpoints.get_slot(slot);
+            if(hw_slot.type == hw_break_type::execute) {
+                cout<<"Hardware breakpoint "<<dec<<slot<<" at address 0x"<<hex<<get_program_counter()<<endl;
+            } else {
+                cout<<"Watchpoint "<<dec<<slot<<" ("<<to_string(hw_slot.type)<<") hit on 0x"<<hex<<hw_slot.addr
+                    <<" value 0x"<<read_memory(hw_slot.addr)<<" at address 0x"<<get_program_counter()<<endl;
+            }
+
+            // Watchpoints often fire inside code without line info (e.g. memcpy in libc)
+            try {
+                auto line_entry = get_line_entry_using_pc(get_offset_program_counter());
+                print_source(line_entry->file->path, line_entry->line, 2);
+            } catch(out_of_range&) {}
+            break;
+        }
+        case TRAP_TRACE:
+            break;
+        case SIGTRAP | 0x80:
+            report_syscall();
+            break;
+        default:
+            cout<<"Unknown trap!!"<<endl;
+    }
+    return;
+
+}
+
+void debugger::report_breakpoint() {
+
+    cout<<"Breakpoint at address 0x"<<hex<<get_program_counter()<<" in "<<symbolize(get_program_counter());
+    auto bp = addr_to_bp.find(get_program_counter());
+    if(bp != addr_to_bp.end() && bp->second.get_hits() > 1) {
+        cout<<", hit "<<dec<<bp->second.get_hits()<<" times";
+    }
+    cout<<endl;
+
+    // Breakpoints by address can be in code without line info
+    auto module = m_modules.find(get_program_counter());
+    if(module != nullptr) {
+        string path;
+        unsigned line;
+        if(module->find_source(get_program_counter(), &path, &line)) {
+            print_source(path, line, 2);
+        }
+        return;
+    }
+    try {
+        auto line_entry = get_line_entry_using_pc(get_offset_program_counter());
+        print_source(line_entry->file->path, line_entry->line, 2);
+    } catch(out_of_range&) {}
+
+}
+
+void debugger::step_over_breakpoint() {
+
+    if(addr_to_bp.count(get_program_counter())) {
+        auto& breakpoint = addr_to_bp[get_program_counter()];
+
+        if (breakpoint.is_enabled()) {
+            // In non-stop mode the running threads would miss the breakpoint while its int3 is removed, they
+            // are halted for the single step and let go again after it
+            vector<pid_t> halted;
+            if(m_non_stop) {
+                for(auto& entry: m_threads) {
+                    if(!entry.second.stopped) {
+                        halted.push_back(entry.first);
+                    }
+                }
+                if(!halted.empty()) {
+                    stop_other_threads();
+                }
+            }
+
+            auto addr = breakpoint.get_addr();
+            patch_breakpoints({addr}, false);
+            resume(PTRACE_SINGLESTEP);
+            wait_for_signal();
+            patch_breakpoints({addr}, true);
+
+            // Threads that stopped for something else meanwhile report it at the next continue
+            for(auto tid: halted) {
+                auto thread = m_threads.find(tid);
+                if(thread != m_threads.end() && thread->second.stopped && !thread->second.has_pending_event) {
+                    resume_thread(thread->second, PTRACE_CONT);
+                }
+            }
+        }
+    }
+}
+
+// The load bias is the difference between where the executable is mapped and where it is linked. The
+// mapping is found by its inode in /proc/pid/maps, as it isn't necessarily the first line of the file.
+void debugger::initialize_load_address() {
+
+    // Position dependent executables are loaded at their link addresses
+    if(m_elf.get_hdr().type != elf::et::dyn) {
+        m_load_address = 0;
+        return;
+    }
+
+    struct stat exe;
+    if(stat(m_prog_name.c_str(), &exe) < 0) {
+        cerr<<"Cannot stat "<<m_prog_name<<"!!!\n";
+        return;
+    }
+
+    char real_path[PATH_MAX];
+    string exe_path = realpath(m_prog_name.c_str(), real_path) ? real_path : m_prog_name;
+
+    auto link_address = get_first_load_address(m_elf);
+
+    ifstream maps("/proc/" + to_string(m_pid) + "/maps");
+    string mapping;
+    while(getline(maps, mapping)) {
+        istringstream fields{mapping};
+        string range, permissions, offset, device, path;
+        unsigned long inode;
+        fields>>range>>permissions>>offset>>device>>inode>>path;
+
+        if(stoull(offset, 0, 16) != 0) {
+            continue;
+        }
+
+        auto major = stoul(device.substr(0, device.find(':')), 0, 16);
+        auto minor = stoul(device.substr(device.find(':') + 1), 0, 16);
+
+        // Overlay filesystems can report another device here, the path is checked too
+        if((inode == exe.st_ino && makedev(major, minor) == exe.st_dev) || path == exe_path) {
+            m_load_address = stoull(range.substr(0, range.find('-')), 0, 16) - link_address;
+            return;
+        }
+    }
+
+    cerr<<"Cannot find the load address of "<<m_prog_name<<"!!!\n";
+
+}
+
+// Shared objects are listed by the link map of the dynamic linker, found through the DT_DEBUG entry of the
+// executable. The dynamic linker calls _dl_debug_state (r_brk) every time it maps or unmaps objects, a
+// breakpoint there keeps the module map up to date.
+void debugger::init_shared_libraries() {
+
+    // Statically linked programs have no dynamic linker
+    string interpreter;
+    for(auto& segment: m_elf.segments()) {
+        if(segment.get_hdr().type == elf::pt::interp) {
+            interpreter = string{static_cast<const char*>(segment.data())};
+        }
+    }
+    if(interpreter.empty()) {
+        return;
+    }
+
+    uint64_t debug_state = 0;
+
+    if(find_r_debug()) {
+        // Attached to a running program, the link map is already set up
+        r_debug link_state;
+        if(m_memory.read(m_r_debug, &link_state, sizeof(link_state))) {
+            debug_state = link_state.r_brk;
+        }
+        update_shared_libraries();
+    } else {
+        // The dynamic linker has not run yet, _dl_debug_state is found in its own symbol table
+        uint64_t base;
+        if(!find_mapping(interpreter, &base)) {
+            cerr<<"Cannot find the dynamic linker "<<interpreter<<"!!!\n";
+            return;
+        }
+
+        shared_module linker{interpreter, 0};
+        if(!linker.valid()) {
+            return;
+        }
+        auto bias = base - linker.get_low();
+
+        for(auto& symbol: linker.lookup_symbol("_dl_debug_state")) {
+            if(symbol.type == symbol_type::func && symbol.address != 0) {
+                debug_state = symbol.address + bias;
+            }
+        }
+    }
+
+    if(debug_state == 0) {
+        cerr<<"Cannot find _dl_debug_state, shared libraries are not tracked!!!\n";
+        return;
+    }
+
+    add_breakpoints({static_cast<intptr_t>(debug_state)});
+    m_bp_actions[debug_state] = [this]() {
+        return update_shared_libraries();
+    };
+
+}
+
+// The dynamic linker stores the address of r_debug in the DT_DEBUG entry of the executable
+bool debugger::find_r_debug() {
+
+    if(m_r_debug != 0) {
+        return true;
+    }
+
+    auto& dynamic = m_elf.get_section(".dynamic");
+    if(!dynamic.valid()) {
+        return false;
+    }
+
+    auto addr = dynamic.get_hdr().addr + m_load_address;
+    for(size_t i = 0; i < dynamic.size() / sizeof(Elf64_Dyn); i++) {
+        Elf64_Dyn entry;
+        if(!m_memory.read(addr + i * sizeof(entry), &entry, sizeof(entry)) || entry.d_tag == DT_NULL) {
+            break;
+        }
+        if(entry.d_tag == DT_DEBUG) {
+            m_r_debug = entry.d_un.d_ptr;
+            break;
+        }
+    }
+
+    return m_r_debug != 0;
+
+}
+
+// Rereads the link map, objects keep their indexes as long as they stay mapped. Always lets the program run on.
+bool debugger::update_shared_libraries() {
+
+    if(!find_r_debug()) {
+        return true;
+    }
+
+    // _dl_debug_state is also called before objects are mapped and before they are unmapped
+    r_debug link_state;
+    if(!m_memory.read(m_r_debug, &link_state, sizeof(link_state)) || link_state.r_state != r_debug::RT_CONSISTENT) {
+        return true;
+    }
+
+    vector<pair<string, uint64_t>> objects;
+    auto map_addr = reinterpret_cast<uint64_t>(link_state.r_map);
+
+    // The length bound protects against a corrupted list
+    while(map_addr != 0 && objects.size() < 4096) {
+        link_map object;
+        if(!m_memory.read(map_addr, &object, sizeof(object))) {
+            break;
+        }
+
+        // The executable has an empty name and the vDSO has no file
+        auto name = read_string(reinterpret_cast<uint64_t>(object.l_name));
+        if(!name.empty()) {
+            // dlopen paths are relative to the working directory of the program
+            if(name[0] != '/') {
+                name = "/proc/" + to_string(m_pid) + "/cwd/" + name;
+            }
+            objects.emplace_back(name, object.l_addr);
+        }
+
+        map_addr = reinterpret_cast<uint64_t>(object.l_next);
+    }
+
+    auto added = m_modules.update(objects);
+    if(added != 0) {
+        cout<<"Loaded "<<dec<<added<<" shared libraries"<<endl;
+    }
+
+    return true;
+
+}
+
+// Start of the mapping of a file at offset 0
+bool debugger::find_mapping(const string& path, uint64_t* start) {
+
+    char real_path[PATH_MAX];
+    string file_path = realpath(path.c_str(), real_path) ? real_path : path;
+
+    ifstream maps("/proc/" + to_string(m_pid) + "/maps");
+    string mapping;
+    while(getline(maps, mapping)) {
+        istringstream fields{mapping};
+        string range, permissions, offset, device, inode, mapped_path;
+        fields>>range>>permissions>>offset>>device>>inode>>mapped_path;
+
+        if(stoull(offset, 0, 16) == 0 && mapped_path == file_path) {
+            *start = stoull(range.substr(0, range.find('-')), 0, 16);
+            return true;
+        }
+    }
+
+    return false;
+
+}
+
+// Reads a NUL terminated string of the tracee, a chunk at a time without crossing pages
+string debugger::read_string(uint64_t addr) {
+
+    string result;
+
+    while(addr != 0 && result.size() < PATH_MAX) {
+        char chunk[64];
+        auto len = min<uint64_t>(sizeof(chunk), memory_cache::page_size - (addr & (memory_cache::page_size - 1)));
+        if(!m_memory.read(addr, chunk, len)) {
+            break;
+        }
+
+        auto end = find(chunk, chunk + len, '\0');
+        result.append(chunk, end);
+        if(end != chunk + len) {
+            break;
+        }
+        addr += len;
+    }
+
+    return result;
+
+}
+
+void debugger::print_modules() {
+
+    if(m_modules.size() == 0) {
+        cout<<"No shared libraries loaded"<<endl;
+        return;
+    }
+
+    m_modules.for_each([](shared_module& module) {
+        cout<<"0x"<<hex<<module.get_low()<<"-0x"<<module.get_high()<<" "<<module.get_path()<<endl;
+    });
+
+}
+
+uint64_t debugger::get_offset_load_address(uint64_t addr) {
+    return addr - m_load_address;
+}
+
+// The global function index, or while it is being built the index of the compile unit containing pc
+const function_index* debugger::get_function_index(uint64_t pc) {
+
+    if(!m_indexer) {
+        return &m_func_index;
+    }
+
+    auto cu = m_cu_index.find_position(pc);
+    return cu < 0 ? nullptr : &m_indexer->get_functions(cu);
+
+}
+
+const line_index* debugger::get_line_index(uint64_t pc) {
+
+    if(!m_indexer) {
+        return &m_line_index;
+    }
+
+    auto cu = m_cu_index.find_position(pc);
+    return cu < 0 ? nullptr : &m_indexer->get_lines(cu);
+
+}
+
+// Switches to the global indexes once the background indexing is done, or waits for it. Lookups by name
+// or by file need every compile unit. Called between commands, when no iterator of a per-unit index is held.
+void debugger::finish_indexing(bool wait) {
+
+    if(!m_indexer) {
+        return;
+    }
+
+    if(wait) {
+        m_indexer->wait();
+    }
+    if(!m_indexer->done()) {
+        return;
+    }
+
+    m_indexer->merge(m_func_index, m_line_index, m_names);
+    m_background_index_time = m_indexer->get_build_time();
+    m_index_steals = m_indexer->get_steals();
+    m_indexer.reset();
+
+    m_events.add_idle_task([this]() {
+        m_index_cache.save(m_elf, m_func_index, m_line_index, m_symbols, m_names, m_cu_index);
+        return false;
+    });
+
+}
+
+dwarf::die debugger::get_func_using_pc(uint64_t pc) {
+
+    auto lookup_start = chrono::steady_clock::now();
+
+    // Addresses outside of every compile unit (PLT stubs, shared libraries, ...) can't have a function.
+    // Otherwise binary search in the function index built at startup.
+    auto functions = m_cu_index.find(pc) != nullptr ? get_function_index(pc) : nullptr;
+    auto function = functions ? functions->find(pc) : nullptr;
+
+    m_function_lookups++;
+    m_function_lookup_time += chrono::steady_clock::now() - lookup_start;
+
+    if(function == nullptr) {
+        throw out_of_range{"Function not found!!!"};
+    }
+
+    return functions->get_die(*function);
+}
+
+line_index::iterator debugger::get_line_entry_using_pc(uint64_t pc) {
+
+    if(m_cu_index.find(pc) == nullptr) {
+        throw out_of_range{"Line Table not found!!!"};
+    }
+
+    auto lines = get_line_index(pc);
+    auto iterator = lines->find_address(pc);
+
+    if(iterator == lines->end()) {
+        throw out_of_range{"Line Table not found!!!"};
+    }
+
+    return iterator;
+}
+
+void debugger::print_source(string file_name, unsigned line, unsigned context_size) {
+
+    ifstream file {file_name};
+
+    // Defining the start and end of window around line to print
+    auto start_line = (line > context_size) ? (line - context_size) : 1;
+    auto end_line = line + context_size + ((context_size > line) ? (context_size - line) : 0) + 1;
+
+    char c{};
+    auto current = 1u;
+    while(current != start_line && file.get(c)) {
+        if(c == '\n') {
+            current++;
+        }
+    }
+
+    if(current == line) {
+        cout<<"> ";
+    }else{
+        cout<<" ";
+    }
+
+    while(current <= end_line && file.get(c)) {
+        cout<<c;
+        if(c == '\n'){
+            current++;
+            cout<<(current == line) ? "> " : " ";
+        }
+    }
+
+    cout<<endl;
+}
+
+siginfo_t debugger::get_signal_info() {
+    siginfo_t s_info;
+    ptrace(PTRACE_GETSIGINFO, m_tid, nullptr, &s_info);
+    return s_info;
+}
+
+void debugger::single_step_instruction() {
+    resume(PTRACE_SINGLESTEP);
+    wait_for_signal();
+}
+
+void debugger::single_step_instruction_with_bp_check() {
+    if(addr_to_bp.count(get_program_counter())) {
+        step_over_breakpoint();
+    } else {
+        single_step_instruction();
+    }
+}
+
+// For stepping out, set breakpoint at return address and continue execution from there
+void debugger::step_out() {
+
+    auto return_address = get_return_address();
+
+    bool remove_bp = false;
+    if(addr_to_bp.count(return_address) == 0) {
+        addBreakpoint(return_address);
+        remove_bp = true;
+    }
+
+    continue_execution(false);
+
+    if (remove_bp) {
+        remove_breakpoint(return_address);
+    }
+
+}
+
+// The kernel sets the resume flag when an instruction breakpoint fires, so continuing doesn't trap again
+void debugger::add_hw_breakpoint(uint64_t addr, hw_break_type type, unsigned len) {
+
+    auto slot = m_hw_breakpoints.set(addr, type, len);
+
+    if(slot < 0) {
+        cerr<<"Cannot set hardware breakpoint at 0x"<<hex<<addr<<" (all slots used or unaligned address)!!!\n";
+        return;
+    }
+
+    cout<<"Set hardware "<<to_string(type)<<" breakpoint "<<dec<<slot<<" at address 0x"<<hex<<addr<<endl;
+
+}
+
+void debugger::remove_breakpoint(intptr_t addr) {
+    if(addr_to_bp.at(addr).is_enabled()) {
+        patch_breakpoints({addr}, false);
+    }
+    addr_to_bp.erase(addr);
+    m_conditions.erase(addr);
+    m_tracepoints.erase(addr);
+    m_calltrace_entries.erase(addr);
+    m_calltrace_returns.erase(addr);
+    m_calltrace_user_returns.erase(addr);
+    m_bp_actions.erase(addr);
+}
+
+// For step_in, run till we reach a new line. Within the address range of the current line the tracee runs at
+// full speed and is only single-stepped on calls, returns and indirect jumps, or when the code can't be decoded.
+void debugger::step_in() {
     auto line_entry = get_line_entry_using_pc(get_offset_program_counter());
+    auto line = line_entry->line;
+    auto file = line_entry->file;
+
+    do {
+        dwarf::taddr low, high;
+        auto lines = get_line_index(get_offset_program_counter());
+        if(lines == nullptr || !lines->find_line_range(get_offset_program_counter(), &low, &high) || !step_through_range(low, high)) {
+            single_step_instruction_with_bp_check();
+        }
+        line_entry = get_line_entry_using_pc(get_offset_program_counter());
+    } while(line_entry->line == line && line_entry->file == file);
+
     print_source(line_entry->file->path, line_entry->line, 2);
 }
 
+// Runs the tracee till it leaves [low, high). Temporary breakpoints are put on every instruction which can
+// leave the range without a decodable target and on every target outside of it. Returns false without
+// running anything if the range can't be decoded.
+bool debugger::step_through_range(dwarf::taddr low, dwarf::taddr high) {
+
+    auto load_low = get_offset_dwarf_address(low);
+    auto load_high = get_offset_dwarf_address(high);
+
+    vector<uint8_t> code(high - low);
+    if(!m_memory.read(load_low, code.data(), code.size())) {
+        return false;
+    }
+
+    // The decoder must see the original instructions, not our breakpoints
+    for(auto& bp: addr_to_bp) {
+        if(bp.second.is_enabled() && static_cast<uint64_t>(bp.first) >= load_low && static_cast<uint64_t>(bp.first) < load_high) {
+            code[bp.first - load_low] = bp.second.get_saved_data();
+        }
+    }
+
+    // Instructions inside the range which are single-stepped, and addresses outside of it where we stop
+    set<uint64_t> step_points;
+    set<uint64_t> exit_points {load_high};
+
+    for(size_t pos = 0; pos < code.size();) {
+        x86_insn insn;
+        if(!x86_decoder::decode(code.data() + pos, code.size() - pos, load_low + pos, &insn)) {
+            return false;
+        }
+
+        switch(insn.kind) {
+            case insn_kind::jump:
+            case insn_kind::cond_jump:
+                if(insn.target < load_low || insn.target >= load_high) {
+                    exit_points.insert(insn.target);
+                }
+                break;
+            case insn_kind::call:
+            case insn_kind::indirect_call:
+            case insn_kind::indirect_jump:
+            case insn_kind::ret:
+                step_points.insert(load_low + pos);
+                break;
+            default:
+                break;
+        }
+
+        pos += insn.length;
+    }
+
+    vector<intptr_t> temp_bps;
+    for(auto& points: {step_points, exit_points}) {
+        for(auto addr: points) {
+            if(addr_to_bp.count(addr) == 0) {
+                temp_bps.push_back(addr);
+            }
+        }
+    }
+    add_breakpoints(temp_bps);
+
+    while(true) {
+        auto pc = get_program_counter();
+
+        if(pc < load_low || pc >= load_high) {
+            break;
+        }
+
+        // Calls, returns, indirect jumps and user breakpoints inside the range are stepped over one instruction
+        if(step_points.count(pc) || addr_to_bp.count(pc)) {
+            single_step_instruction_with_bp_check();
+            continue;
+        }
+
+        resume(PTRACE_CONT);
+
+        // Stopped by a signal or the tracee exited
+        if(!wait_for_breakpoint()) {
+            break;
+        }
+    }
+
+    remove_breakpoints(temp_bps);
+    return true;
+
+}
+
 uint64_t debugger::get_offset_program_counter() {
     return get_offset_load_address(get_program_counter());
 }
@@ -448,6 +2630,8 @@ uint64_t debugger::get_offset_dwarf_address(uint64_t addr) {
 // For step over, setting a breakpoint at every line in the current function
 void debugger::step_over() {
 
+    auto step_start = chrono::steady_clock::now();
+
     // Get function using program counter
     auto function = get_func_using_pc(get_offset_program_counter());
     auto func_start = dwarf::at_low_pc(function);
@@ -463,106 +2647,550 @@ void debugger::step_over() {
     // Iterating upto end of function and adding breakpoint which are not the start and there is no breakpoint beforehand
     while(line->address < func_end) {
         auto load_addr = get_offset_dwarf_address(line->address);
-        if((line->address != start_line_entry->address) && (addr_to_bp.count(load_addr) == 0)) {
-            addBreakpoint(load_addr);
+        if((line->address != start_line_entry->address) && (addr_to_bp.count(load_addr) == 0) &&
+            (bp_to_delete.empty() || bp_to_delete.back() != static_cast<intptr_t>(load_addr))) {
             bp_to_delete.push_back(load_addr);
         }
         line++;
     }
 
     // Similar to step_out, adding breakpoint to return address
-    auto frame_pointer = get_register_value_from_type(m_pid, register_type::rbp);
-    auto return_address = read_memory(frame_pointer + 8);
+    auto return_address = get_return_address();
 
-    if(addr_to_bp.count(return_address) == 0) {
-        addBreakpoint(return_address);
+    if(addr_to_bp.count(return_address) == 0 && find(bp_to_delete.begin(), bp_to_delete.end(), return_address) == bp_to_delete.end()) {
         bp_to_delete.push_back(return_address);
     }
 
+    // The temporary breakpoints are inserted and removed in one batch, without printing each of them
+    add_breakpoints(bp_to_delete);
+
     // Continuing the execution
-    continue_execution();
+    continue_execution(false);
 
     // Removing all breakpoints after step_over
-    for (auto bp: bp_to_delete) {
-        remove_breakpoint(bp);
-    }
+    remove_breakpoints(bp_to_delete);
+
+    m_step_over_count++;
+    m_step_over_time += chrono::steady_clock::now() - step_start;
 
 }
 
 void debugger::set_bp_at_func(string name) {
 
-    for(auto& compile_unit: m_dwarf.compilation_units()) {
-        for(auto& die: compile_unit.root()) {
-            if(die.has(dwarf::DW_AT::name) && (dwarf::at_name(die) == name)) {
-                auto low_pc = dwarf::at_low_pc(die);
-                auto line_entry = get_line_entry_using_pc(low_pc);
-                // Here, before starting function there is a prologue which needs to be skipped
-                line_entry++;
-                addBreakpoint(get_offset_dwarf_address(line_entry->address));
+    // Hash lookup in the symbol table first, C++ functions are only found by their mangled name there
+    set<uintptr_t> addresses;
+    for(auto& symbol: lookup_symbol(name)) {
+        if(symbol.type == symbol_type::func && symbol.address != 0) {
+            addresses.insert(symbol.address);
+        }
+    }
+
+    // Here, before starting function there is a prologue which needs to be skipped. Functions without
+    // line info, like _start or assembly routines, break at their first instruction.
+    auto break_after_prologue = [this](uintptr_t low_pc) {
+        try {
+            auto line_entry = get_line_entry_using_pc(low_pc);
+            line_entry++;
+            addBreakpoint(get_offset_dwarf_address(line_entry->address));
+        } catch(out_of_range&) {
+            addBreakpoint(get_offset_dwarf_address(low_pc));
+        }
+    };
+
+    for(auto low_pc: addresses) {
+        break_after_prologue(low_pc);
+    }
+
+    if(!addresses.empty()) {
+        return;
+    }
+
+    // Plain names of C++ functions and methods are found in the name index, which needs every compile unit
+    finish_indexing(true);
+
+    auto break_at_function = [this, &addresses, &break_after_prologue](const name_index::entry& entry) {
+        if(entry.name_kind != name_index::kind::function && entry.name_kind != name_index::kind::global) {
+            return;
+        }
+
+        // Names from .debug_pubnames can also be variables
+        auto die = m_names.get_die(entry);
+        if(die.tag != dwarf::DW_TAG::subprogram || !die.has(dwarf::DW_AT::low_pc) || !addresses.insert(dwarf::at_low_pc(die)).second) {
+            return;
+        }
+
+        break_after_prologue(dwarf::at_low_pc(die));
+    };
+
+    for(auto entry: m_names.lookup(name)) {
+        break_at_function(*entry);
+    }
+    // Static functions and plain method names are not in .debug_pubnames
+    if(addresses.empty() && m_names.from_pubnames()) {
+        for(auto entry: m_names.lookup_dies(name)) {
+            break_at_function(*entry);
+        }
+    }
+
+    if(!addresses.empty()) {
+        return;
+    }
+
+    // Functions of shared libraries, which mostly have no line info, break at their entry
+    m_modules.for_each([this, &addresses, &name](shared_module& module) {
+        for(auto& symbol: module.lookup_symbol(name)) {
+            if(symbol.type == symbol_type::func && symbol.address != 0 && addresses.insert(symbol.address).second) {
+                addBreakpoint(symbol.address);
             }
         }
+    });
+
+    if(addresses.empty()) {
+        cerr<<"Function "<<name<<" not found!!!\n";
     }
 
 }
 
 void debugger::set_bp_at_source_line(string file_name, unsigned line) {
 
-    for(auto& compile_unit: m_dwarf.compilation_units()) {
-        if(is_suffix(file_name, dwarf::at_name(compile_unit.root()))) {
-            auto line_table = compile_unit.get_line_table();
-            for(auto& line_entry: line_table) {
-                // is_stmt -> check that line table entry is marked as the beginning of a statement
-                if(line_entry.is_stmt && (line_entry.address == line)) {
-                    addBreakpoint(get_offset_dwarf_address(line_entry.address));
-                    return;
-                }
-            }
+    // Any compile unit can have rows for the file
+    finish_indexing(true);
+
+    // is_stmt -> only line table entries marked as the beginning of a statement are indexed by line
+    dwarf::taddr address;
+    if(m_line_index.find_line(file_name, line, &address)) {
+        addBreakpoint(get_offset_dwarf_address(address));
+        return;
+    }
+
+    bool found = false;
+    m_modules.for_each([this, &found, &file_name, line](shared_module& module) {
+        uint64_t module_address;
+        if(!found && module.find_line(file_name, line, &module_address)) {
+            addBreakpoint(module_address);
+            found = true;
         }
+    });
+
+    if(!found) {
+        cerr<<"No code found at "<<file_name<<":"<<dec<<line<<"!!!\n";
     }
 
 }
 
 vector<symbol> debugger::lookup_symbol(string name) {
+    return m_symbols.lookup(name);
+}
+
+// Finds the function containing an offset pc, from the DWARF info or else from the symbol tables
+bool debugger::get_function_at(uint64_t pc, string* name, uint64_t* start) {
+
+    auto functions = get_function_index(pc);
+    auto function = functions ? functions->find(pc) : nullptr;
+    if(function != nullptr) {
+        auto& die = functions->get_die(*function);
+        if(die.has(dwarf::DW_AT::name)) {
+            *name = dwarf::at_name(die);
+            *start = function->low;
+            return true;
+        }
+    }
+
+    auto sym = m_symbols.find_address(pc);
+    if(sym != nullptr) {
+        *name = string{sym->name};
+        *start = sym->address;
+        return true;
+    }
+
+    return false;
+
+}
+
+// Same with a runtime address and start, looked up in the shared object containing it if any
+bool debugger::find_function(uint64_t addr, string* name, uint64_t* start) {
+
+    auto module = m_modules.find(addr);
+    if(module != nullptr) {
+        return module->find_function(addr, name, start);
+    }
+
+    if(!get_function_at(get_offset_load_address(addr), name, start)) {
+        return false;
+    }
+    *start += m_load_address;
+    return true;
+
+}
+
+// Formats a runtime address as function+offset, works without debug info
+string debugger::symbolize(uint64_t addr) {
+
+    string name;
+    uint64_t start;
+    if(!find_function(addr, &name, &start)) {
+        return "??";
+    }
+
+    stringstream ss;
+    ss<<name;
+    if(addr != start) {
+        ss<<"+0x"<<hex<<(addr - start);
+    }
+    return ss.str();
+
+}
+
+unwind_registers debugger::get_unwind_registers() {
+
+    unwind_registers regs;
+    for(unsigned reg = 0; reg < unwind_registers::return_address; reg++) {
+        regs.values[reg] = get_register_value_from_dwarf_register(*m_registers, reg);
+        regs.known[reg] = true;
+    }
+    regs.values[unwind_registers::return_address] = get_program_counter();
+    regs.known[unwind_registers::return_address] = true;
+
+    return regs;
+
+}
+
+// Moves regs to the calling frame, using the CFI of the binary and the frame pointer chain when there is none
+bool debugger::unwind_frame(unwind_registers& regs, bool innermost) {
+
+    // Return addresses can be right past the end of a function
+    auto pc = regs.values[unwind_registers::return_address];
+    auto module = m_modules.find(innermost ? pc : pc - 1);
+
+    if(module != nullptr ? module->unwind(regs, m_memory, innermost) : m_unwinder.step(regs, m_memory, m_load_address, innermost)) {
+        return true;
+    }
+
+    if(!regs.known[unwind_registers::rbp] || regs.values[unwind_registers::rbp] == 0) {
+        return false;
+    }
+
+    auto frame_pointer = regs.values[unwind_registers::rbp];
+    regs.values[unwind_registers::return_address] = read_memory(frame_pointer + 8);
+    regs.values[unwind_registers::rbp] = read_memory(frame_pointer);
+    regs.values[unwind_registers::rsp] = frame_pointer + 16;
+    regs.known[unwind_registers::rsp] = true;
+
+    return true;
+
+}
+
+uint64_t debugger::get_return_address() {
+
+    auto regs = get_unwind_registers();
+    if(!unwind_frame(regs, true)) {
+        throw out_of_range{"Cannot find the return address!!!"};
+    }
+
+    return regs.values[unwind_registers::return_address];
+
+}
+
+void debugger::print_backtrace() {
+
+    // Lambda expression for printing frame
+    auto output_frame = [frame_np = 0] (const string& name, uint64_t start) mutable {
+        cout<<"Frame number: #"<<dec<<(frame_np++)<<" 0x"<<hex<<start<<" "<<name<<endl;
+    };
+
+    string name;
+    uint64_t start;
+    if(!find_function(get_program_counter(), &name, &start)) {
+        throw out_of_range{"Function not found!!!"};
+    }
+    output_frame(name, start);
+
+    auto regs = get_unwind_registers();
+
+    // Frames without a symbol, or that can't be unwound, end the backtrace
+    for(bool innermost = true; name != "main" && unwind_frame(regs, innermost); innermost = false) {
+        auto return_address = regs.values[unwind_registers::return_address];
+        if(return_address == 0) {
+            break;
+        }
+        if(!find_function(return_address, &name, &start)) {
+            output_frame("??", return_address);
+            break;
+        }
+        output_frame(name, start);
+    }
+
+}
+
+// Stack of the stopped tracee, innermost PC first. Return addresses are moved back into their call instruction.
+vector<uint64_t> debugger::sample_stack(uint64_t stack_end) {
+
+    constexpr size_t max_depth = 128;
+    constexpr uint64_t stack_window = 64 * 1024;
+
+    auto regs = get_unwind_registers();
+
+    // One read brings the top of the stack into the memory cache, the unwinder then only hits cached pages
+    auto stack_pointer = regs.values[unwind_registers::rsp];
+    if(stack_pointer < stack_end) {
+        m_memory.prefetch(stack_pointer, min(stack_end - stack_pointer, stack_window));
+    }
 
-    vector<symbol> symbols;
+    vector<uint64_t> stack;
+    for(bool innermost = true; stack.size() < max_depth; innermost = false) {
+        auto pc = regs.values[unwind_registers::return_address];
+        if(pc == 0) {
+            break;
+        }
+        stack.push_back(innermost ? pc : pc - 1);
+        if(!unwind_frame(regs, innermost)) {
+            break;
+        }
+    }
+
+    return stack;
+
+}
+
+// Sampling profiler: every thread of the tracee (attached with PTRACE_SEIZE, new threads with it) is interrupted
+// at a fixed rate, their stacks are unwound and they are resumed, until it exits. The stacks are then written
+// in the collapsed format.
+void debugger::profile(unsigned frequency, const string& output_path) {
+
+    int wait_status;
+
+    // The tracee stops at the exec of the program, before running any of it
+    waitpid(m_pid, &wait_status, __WALL);
+    if(!WIFSTOPPED(wait_status)) {
+        cerr<<"Program did not start!!!\n";
+        return;
+    }
+    initialize_load_address();
+
+    // End of the main thread stack, the limit of the stack prefetch
+    uint64_t stack_end = 0;
+    ifstream maps("/proc/" + to_string(m_pid) + "/maps");
+    string mapping;
+    while(getline(maps, mapping)) {
+        if(mapping.find("[stack]") != string::npos) {
+            stack_end = stoul(mapping.substr(mapping.find('-') + 1), 0, 16);
+        }
+    }
+
+    sample_profile samples;
+    auto period = chrono::nanoseconds{1000000000 / frequency};
+    auto next_sample = chrono::steady_clock::now();
+
+    resume(PTRACE_CONT);
+
+    while(true) {
+        next_sample += period;
+        this_thread::sleep_until(next_sample);
+
+        // Every thread is interrupted, new threads stop on their own when they start
+        auto sample_start = chrono::steady_clock::now();
+        for(auto& entry: m_threads) {
+            auto& thread = entry.second;
+            if(!thread.stopped && !thread.stop_requested) {
+                ptrace(PTRACE_INTERRUPT, thread.tid, nullptr, nullptr);
+                thread.stop_requested = true;
+            }
+        }
 
-    for(auto& section: m_elf.sections()) {
-        // Symbol tables can only be present in sections of type DYNSYM or SYMTAB
-        if ((section.get_hdr().type == elf::sht::dynsym) || section.get_hdr().type == elf::sht::symtab) {
+        // Signals the threads got meanwhile are passed on, and a thread reporting a clone goes on, until
+        // their interrupt stop arrives
+        auto all_stopped = [this]() {
+            return all_of(m_threads.begin(), m_threads.end(), [](auto&& entry) { return entry.second.stopped; });
+        };
+        while(!m_exited && !all_stopped()) {
+            auto tid = waitpid(-1, &wait_status, __WALL);
+            if(tid < 0) {
+                break;
+            }
+
+            auto reported = handle_thread_event(tid, wait_status);
+            auto iter = m_threads.find(tid);
+            if(m_exited || iter == m_threads.end()) {
+                continue;
+            }
 
-            for(auto sym: section.as_symtab()) {
-                if (sym.get_name() == name) {
-                    auto& data = sym.get_data();
-                    symbols.push_back(symbol{map_elf_symbol_to_struct_symbol_type(data.type()), sym.get_name(), data.value});
+            auto& thread = iter->second;
+            if(reported || (wait_status >> 16) == PTRACE_EVENT_CLONE) {
+                if(reported && (wait_status >> 16) == 0) {
+                    thread.pending_signal = WSTOPSIG(wait_status);
                 }
+                resume_thread(thread, PTRACE_CONT);
+            }
+        }
+
+        if(m_exited) {
+            break;
+        }
+
+        for(auto& entry: m_threads) {
+            switch_thread(entry.first);
+
+            // Only the stack of the main thread is known, the other ones are not prefetched
+            auto stack = sample_stack(entry.first == m_pid ? stack_end : 0);
+            samples.add(stack);
+
+            // Code outside of the known objects means libraries were loaded since the last sample
+            string name;
+            uint64_t start;
+            if(!stack.empty() && !find_function(stack[0], &name, &start)) {
+                update_shared_libraries();
             }
+        }
+        switch_thread(m_pid);
 
+        for(auto& entry: m_threads) {
+            resume_thread(entry.second, PTRACE_CONT);
         }
+        m_memory.invalidate();
+        samples.add_overhead(chrono::steady_clock::now() - sample_start);
+    }
+
+    auto written = samples.write_collapsed(output_path, [this](uint64_t pc) {
+        string name;
+        uint64_t start;
+        if(find_function(pc, &name, &start)) {
+            return name;
+        }
+        stringstream ss;
+        ss<<"0x"<<hex<<pc;
+        return ss.str();
+    });
+
+    cout<<dec<<"Profile: "<<samples.get_samples()<<" samples at "<<frequency<<" Hz, average overhead "
+        <<chrono::duration_cast<chrono::microseconds>(samples.get_average_overhead()).count()<<" us per sample"<<endl;
+
+    if(!written) {
+        cerr<<"Cannot write profile to "<<output_path<<"!!!\n";
+        return;
     }
+    cout<<"Collapsed stacks written to "<<output_path<<endl;
 
-    return symbols;
+    m_events.run_idle_tasks();
 
 }
 
-void debugger::print_backtrace() {
+// Line coverage with one-shot breakpoints: every is_stmt row of the line table gets a breakpoint, which is
+// removed the first time it is hit, so the program runs at full speed once its code has been covered.
+// The covered lines are written in the lcov tracefile format when it exits.
+void debugger::coverage(const string& output_path) {
 
-    // Lambda expression for printing frame
-    auto output_frame = [frame_np = 0] (auto&& func) mutable {
-        cout<<"Frame number: #"<<(frame_np++)<<" 0x"<<dwarf::at_low_pc(func)<<" "<<dwarf::at_name(func)<<endl;
+    auto start = chrono::steady_clock::now();
+    int wait_status;
+
+    // The tracee stops at the exec of the program, before running any of it
+    waitpid(m_pid, &wait_status, __WALL);
+    if(!WIFSTOPPED(wait_status)) {
+        cerr<<"Program did not start!!!\n";
+        return;
+    }
+    initialize_load_address();
+    finish_indexing(true);
+
+    // Rows of the same address are the same site, a line is covered when any of its sites is hit
+    struct site {
+        const line_index::file* file;
+        unsigned line;
+        bool hit;
     };
+    unordered_map<intptr_t, site> sites;
+    for(auto& row: m_line_index) {
+        if(row.is_stmt && !row.end_sequence) {
+            sites.emplace(get_offset_dwarf_address(row.address), site{row.file, row.line, false});
+        }
+    }
+
+    vector<intptr_t> addrs;
+    addrs.reserve(sites.size());
+    for(auto& entry: sites) {
+        addrs.push_back(entry.first);
+    }
+    add_breakpoints(addrs);
+
+    auto setup_time = chrono::steady_clock::now() - start;
+    uint64_t hits = 0;
+    uint64_t stops = 0;
+
+    resume(PTRACE_CONT);
+
+    while(!m_exited) {
+        auto tid = waitpid(-1, &wait_status, __WALL);
+        if(tid < 0) {
+            break;
+        }
+
+        auto reported = handle_thread_event(tid, wait_status);
+        auto iter = m_threads.find(tid);
+        if(m_exited || iter == m_threads.end()) {
+            continue;
+        }
+        auto& thread = iter->second;
+
+        if(reported && WSTOPSIG(wait_status) == SIGTRAP && (wait_status >> 16) == 0) {
+            stops++;
+            auto pc = thread.registers.get(register_type::rip) - 1;
+            auto covered = sites.find(pc);
+            if(covered != sites.end()) {
+                // Another thread can have hit the same breakpoint before it was removed
+                if(!covered->second.hit) {
+                    covered->second.hit = true;
+                    hits++;
+                    remove_breakpoints({static_cast<intptr_t>(pc)});
+                }
+                thread.registers.set(register_type::rip, pc);
+                resume_thread(thread, PTRACE_CONT);
+                continue;
+            }
+        }
 
-    auto current_func = get_func_using_pc(get_offset_load_address(get_program_counter()));
-    output_frame(current_func);
+        // Signals are passed on to the program
+        if(reported && (wait_status >> 16) == 0) {
+            thread.pending_signal = WSTOPSIG(wait_status);
+        }
+        resume_thread(thread, PTRACE_CONT);
+    }
+
+    auto exit_time = chrono::steady_clock::now() - start;
+
+    // file -> line -> covered
+    map<string, map<unsigned, bool>> lines;
+    for(auto& entry: sites) {
+        auto& covered = lines[entry.second.file->path][entry.second.line];
+        covered = covered || entry.second.hit;
+    }
+
+    ofstream out(output_path);
+    size_t lines_found = 0;
+    size_t lines_hit = 0;
+
+    for(auto& [path, file_lines]: lines) {
+        size_t file_hit = 0;
+        out<<"TN:\nSF:"<<path<<"\n";
+        for(auto& [line, covered]: file_lines) {
+            out<<"DA:"<<line<<","<<(covered ? 1 : 0)<<"\n";
+            file_hit += covered;
+        }
+        out<<"LH:"<<file_hit<<"\nLF:"<<file_lines.size()<<"\nend_of_record\n";
+        lines_found += file_lines.size();
+        lines_hit += file_hit;
+    }
 
-    auto frame_pointer = get_register_value_from_type(m_pid, register_type::rbp);
-    auto return_address = read_memory(frame_pointer + 8);
+    cout<<dec<<"Coverage: "<<lines_hit<<" of "<<lines_found<<" lines ("<<(lines_found ? 100 * lines_hit / lines_found : 0)<<"%), "
+        <<hits<<" of "<<sites.size()<<" breakpoints hit"<<endl;
+    cout<<"Time to exit "<<chrono::duration_cast<chrono::milliseconds>(exit_time).count()<<" ms, of which "
+        <<chrono::duration_cast<chrono::milliseconds>(setup_time).count()<<" ms placing breakpoints, "<<stops<<" breakpoint stops"<<endl;
 
-    while(dwarf::at_name(current_func) != "main") {
-        current_func = get_func_using_pc(get_offset_load_address(return_address));
-        output_frame(current_func);
-        frame_pointer = read_memory(frame_pointer);
-        return_address = read_memory(frame_pointer + 8);
+    if(!out) {
+        cerr<<"Cannot write coverage to "<<output_path<<"!!!\n";
+        return;
     }
+    cout<<"lcov tracefile written to "<<output_path<<endl;
+
+    m_events.run_idle_tasks();
 
 }
 
@@ -576,7 +3204,7 @@ void debugger::read_variables() {
             auto location = die[DW_AT::location];
 
             if(location.get_type() == value::type::exprloc) {
-                ptrace_expr_context context {m_pid, m_load_address};
+                ptrace_expr_context context {m_pid, *m_registers, m_memory, m_load_address};
                 auto result = location.as_exprloc().evaluate(&context);
 
                 switch (result.location_type) {
@@ -588,7 +3216,7 @@ void debugger::read_variables() {
                     }
                     case expr_result::type::reg:
                     {
-                        auto val = get_register_value_from_dwarf_register(m_pid, result.value);
+                        auto val = get_register_value_from_dwarf_register(*m_registers, result.value);
                         cout<<at_name(die)<<" Address: 0x"<<hex<<result.value<<" Value: "<<val<<endl;
                         break;
                     }
@@ -602,6 +3230,9 @@ void debugger::read_variables() {
 }
 
 void execute_debugee(const string& prog_name) {
+    // Ctrl-C on the terminal goes to the debugger, which decides when to stop the program
+    setpgid(0, 0);
+
     if (ptrace(PTRACE_TRACEME, 0, 0, 0) < 0) {
         cerr << "Error in ptrace\n";
         return;
@@ -609,13 +3240,161 @@ void execute_debugee(const string& prog_name) {
     execl(prog_name.c_str(), prog_name.c_str(), nullptr);
 }
 
+// Starts the program for the profiler. The child waits on a pipe until the parent has attached with
+// PTRACE_SEIZE, which PTRACE_INTERRUPT requires, and then stops at the exec. A seccomp filter is installed
+// by the child once it is traced.
+pid_t launch_seized(const string& prog_name, int options = 0, vector<sock_filter> filter = {}) {
+
+    int sync[2];
+    if(pipe(sync) < 0) {
+        return -1;
+    }
+
+    auto pid = fork();
+
+    if(pid == 0) {
+        personality(ADDR_NO_RANDOMIZE);
+        close(sync[1]);
+
+        char c;
+        read(sync[0], &c, 1);
+        if(!filter.empty() && !install_seccomp_filter(filter)) {
+            _exit(127);
+        }
+        execl(prog_name.c_str(), prog_name.c_str(), nullptr);
+        _exit(127);
+    }
+
+    close(sync[0]);
+    if(pid > 0 && ptrace(PTRACE_SEIZE, pid, nullptr, PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL | options) < 0) {
+        cerr<<"Error in ptrace\n";
+        kill(pid, SIGKILL);
+        pid = -1;
+    }
+
+    // Closing the pipe lets the child continue
+    close(sync[1]);
+
+    return pid;
+
+}
+
 int main(int argc, char** argv) {
+
+    // --lazy-index shows the prompt before the DWARF info is indexed, which is then done in background threads.
+    // --index-threads=N sets how many threads index the compile units.
+    bool lazy_index = false;
+    unsigned index_threads = 0;
+    while (argc > 1) {
+        if (string{argv[1]} == "--lazy-index") {
+            lazy_index = true;
+        } else if (is_prefix("--index-threads=", argv[1])) {
+            index_threads = stoul(string{argv[1]}.substr(strlen("--index-threads=")));
+        } else {
+            break;
+        }
+        argv++;
+        argc--;
+    }
     
     if (argc < 2){
         cerr<<"No program name!!!";
         return -1;
     }
 
+    // --profile=<rate>hz runs the program under the sampling profiler instead of the prompt
+    if (is_prefix("--profile=", argv[1])) {
+        if (argc < 3) {
+            cerr<<"No program name!!!";
+            return -1;
+        }
+
+        string prog_name = argv[2];
+        auto frequency = stoul(string{argv[1]}.substr(strlen("--profile=")));
+        if (frequency == 0 || frequency > 100000) {
+            cerr<<"Invalid sampling rate!!!";
+            return -1;
+        }
+
+        auto pid = launch_seized(prog_name, PTRACE_O_TRACECLONE);
+        if (pid < 0) {
+            return -1;
+        }
+
+        debugger dbg{prog_name, pid, false, index_threads};
+        dbg.profile(frequency, prog_name.substr(prog_name.rfind('/') + 1) + ".folded");
+        return 0;
+    }
+
+    // --coverage runs the program to its exit and writes the lines it ran to <program>.info
+    if (string{argv[1]} == "--coverage") {
+        if (argc < 3) {
+            cerr<<"No program name!!!";
+            return -1;
+        }
+
+        string prog_name = argv[2];
+        auto pid = launch_seized(prog_name, PTRACE_O_TRACECLONE);
+        if (pid < 0) {
+            return -1;
+        }
+
+        debugger dbg{prog_name, pid, false, index_threads};
+        dbg.coverage(prog_name.substr(prog_name.rfind('/') + 1) + ".info");
+        return 0;
+    }
+
+    // --syscalls prints every system call of the program and their statistics, --syscalls=open,read only
+    // those, which a seccomp filter lets the program make without stopping for the other ones
+    if (is_prefix("--syscalls", argv[1])) {
+        if (argc < 3) {
+            cerr<<"No program name!!!";
+            return -1;
+        }
+
+        string option = argv[1];
+        set<long> syscalls;
+        if (option.size() > strlen("--syscalls=")) {
+            for (auto& name: split(option.substr(strlen("--syscalls=")), ',')) {
+                auto number = find_syscall_number(name);
+                if (number < 0) {
+                    cerr<<"Unknown system call "<<name<<"!!!";
+                    return -1;
+                }
+                syscalls.insert(number);
+            }
+        }
+
+        string prog_name = argv[2];
+        auto options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_TRACESECCOMP;
+        auto pid = launch_seized(prog_name, options, syscalls.empty() ? vector<sock_filter>{} : build_seccomp_filter(syscalls));
+        if (pid < 0) {
+            return -1;
+        }
+
+        debugger dbg{prog_name, pid, false, index_threads};
+        dbg.trace_syscalls(syscalls, !syscalls.empty());
+        return 0;
+    }
+
+    // -p PID attaches to a running process, its executable is read through /proc so that it is found
+    // even if it was deleted or replaced on disk since the process started
+    if (string{argv[1]} == "-p") {
+        if (argc < 3) {
+            cerr<<"No process id!!!";
+            return -1;
+        }
+
+        pid_t pid = stoi(argv[2]);
+        debugger dbg{"/proc/" + to_string(pid) + "/exe", pid, lazy_index, index_threads};
+        if (!dbg.attach()) {
+            return -1;
+        }
+
+        dbg.run();
+        return 0;
+    }
+
     auto prog_name = argv[1];
 
     auto pid = fork();
@@ -633,7 +3412,7 @@ int main(int argc, char** argv) {
         // Parent process
 
         cout<<"Started debugging for process "<<pid<<" ...";
-        debugger dbg{prog_name, pid};
+        debugger dbg{prog_name, pid, lazy_index, index_threads};
 
         dbg.run();
 